@@ -19,43 +19,68 @@
  * Control functions for analog-to-digital converter (ADC).
  * The ADC1 interrupt (22) is used to get signal on end of convertion event.
  * The port D6 (pin 3) is used as analog input (AIN6).
+ * Every conversion is a burst of ADC_BURST_SIZE samples being captured
+ * into the data buffer registers in continuous mode, so only one
+ * interrupt is requested per burst. The lowest and the highest samples
+ * are rejected and the rest is summed up to the 12-bit result.
+ * The result is smoothed by the adaptive exponential filter. Its time
+ * constant is PARAM_FILTER_FAST after a step of the signal and
+ * PARAM_FILTER_SLOW while the signal is stable.
+ * The analog watchdog of ADC is armed on every buffer register, so
+ * the relay is forced into its safe state straight from the interrupt
+ * handler when the temperature exceeds PARAM_MAX_TEMPERATURE or the
+ * sensor is disconnected.
+ * The watchdog checks only the samples of bursts, which are started by
+ * the scheduler from the timer's interrupt every 256 ticks. So the worst
+ * case latency of the trip is 512 ms plus the burst itself (about 0.2 ms
+ * at fADC = 16 MHz / 18), and it doesn't depend on the main loop. The
+ * only hardware trigger of ADC1 is TRGO of TIM1, which is busy with the
+ * brightness of display, and the converter running on its own would
+ * request an interrupt every burst of 10 samples (~6 kHz), so the burst
+ * is started by software. The thermal lag of the probe is several
+ * seconds, which is much longer than the latency.
  */
 
 #include "adc.h"
 #include "stm8s003/adc.h"
 #include "params.h"
+#include "relay.h"
+#include "ui.h"
+#include "thermistor.h"
 
-// Averaging bits
-#define ADC_AVERAGING_BITS      4
-#define ADC_RAW_TABLE_SIZE      sizeof rawAdc / sizeof rawAdc[0]
-// Base temperature in tenth of degrees of Celsius.
-#define ADC_RAW_TABLE_BASE_TEMP -520
-
-
-/* The lookup table contains raw ADC values for every degree of Celsius
-   from -52C to 112C. */
-const unsigned int rawAdc[] = {
-    974, 971, 967, 964, 960, 956, 953, 948, 944, 940,
-    935, 930, 925, 920, 914, 909, 903, 897, 891, 884,
-    877, 871, 864, 856, 849, 841, 833, 825, 817, 809,
-    800, 791, 782, 773, 764, 754, 745, 735, 725, 715,
-    705, 695, 685, 675, 664, 654, 644, 633, 623, 612,
-    601, 591, 580, 570, 559, 549, 538, 528, 518, 507,
-    497, 487, 477, 467, 457, 448, 438, 429, 419, 410,
-    401, 392, 383, 375, 366, 358, 349, 341, 333, 326,
-    318, 310, 303, 296, 289, 282, 275, 269, 262, 256,
-    250, 244, 238, 232, 226, 221, 215, 210, 205, 200,
-    195, 191, 186, 181, 177, 173, 169, 165, 161, 157,
-    153, 149, 146, 142, 139, 136, 132, 129, 126, 123,
-    120, 117, 115, 112, 109, 107, 104, 102, 100, 97,
-    95, 93, 91, 89, 87, 85, 83, 81, 79, 78,
-    76, 74, 73, 71, 69, 68, 67, 65, 64, 62,
-    61, 60, 58, 57, 56, 55, 54, 53, 52, 51,
-    49, 48, 47, 47, 46
-};
+// Fraction bits of the filtered result
+#define ADC_FILTER_FRACTION_BITS    4
+// Deviation from the filtered result which is treated as a step
+#define ADC_FILTER_STEP         32
+// Number of data buffer registers
+#define ADC_BURST_SIZE          10
+// Bits being added to the sum of remaining 8 samples
+#define ADC_BURST_EXTRA_BITS    3
+// Bits of the oversampled result
+#define ADC_RESULT_BITS         12
+#define NTC_SEGMENT_MASK        ( (1 << NTC_SEGMENT_BITS) - 1)
+// 10-bit result of conversion when the sensor is disconnected
+#define ADC_SENSOR_OPEN         1010
 
+#if NTC_ADC_BITS != ADC_RESULT_BITS
+#error "Lookup table of thermistor does not match the resolution of ADC result"
+#endif
 static unsigned int result;
-static unsigned long averaged;
+/* Filtered result in 16-bit fixed point and whether it was seeded. */
+static unsigned int filtered;
+static bool filterSeeded;
+/* Filtered result of the last burst. */
+static unsigned int sample;
+/* Incremented by the interrupt handler on every completed burst. */
+static volatile unsigned char sampleCount;
+/* Temperature converted from the last sample and its generation. */
+static int temperature;
+static unsigned char generation;
+static unsigned char convertedCount;
+/* Temperature limit the analog watchdog is configured for. */
+static int watchdogLimit;
+
+static void setupWatchdog();
 
 /**
  * @brief Initialize ADC's configuration registers.
@@ -63,23 +88,38 @@ static unsigned long averaged;
 void initADC()
 {
     ADC_CR1 |= 0x70;    // Prescaler f/18 (SPSEL)
+    ADC_CR3 |= 0x80;    // Data buffer enable (DBUF)
     ADC_CSR |= 0x06;    // select AIN6
     ADC_CSR |= 0x20;    // Interrupt enable (EOCIE)
+    ADC_AWCRH = 0x03;   // Analog watchdog for all buffer registers
+    ADC_AWCRL = 0xFF;
+    ADC_CSR |= 0x10;    // Analog watchdog interrupt enable (AWDIE)
     ADC_CR1 |= 0x01;    // Power up ADC
     result = 0;
-    averaged = 0;
+    filtered = 0;
+    filterSeeded = false;
+    sample = 0;
+    sampleCount = convertedCount = 0;
+    temperature = 0;
+    generation = 0;
+    setupWatchdog();
 }
 
 /**
- * @brief Sets bit in ADC control register to start data convertion.
+ * @brief Sets bits in ADC control register to start the burst of data
+ *  convertions. This function is being called during timer's interrupt
+ *  request, so the period of this task bounds the latency of the
+ *  analog watchdog.
  */
 void startADC()
 {
+    ADC_CR3 &= ~0x40;   // reset OVR
+    ADC_CR1 |= 0x02;    // Continuous conversion (CONT)
     ADC_CR1 |= 0x01;
 }
 
 /**
- * @brief Gets raw result of last data conversion.
+ * @brief Gets raw result of last data conversion (median of the burst).
  * @return raw result.
  */
 unsigned int getAdcResult()
@@ -88,63 +128,224 @@ unsigned int getAdcResult()
 }
 
 /**
- * @brief Gets averaged over 2^ADC_AVERAGING_BITS times result of data
- *  convertion.
- * @return averaged result.
+ * @brief Gets filtered 12-bit result of data convertion.
+ * @return filtered result.
  */
 unsigned int getAdcAveraged()
 {
-    return (unsigned int) (averaged >> ADC_AVERAGING_BITS);
+    return sample;
 }
 
 /**
  * @brief Calculation of real temperature using averaged result of
- *  AnalogToDigital conversion and the lookup table.
+ *  AnalogToDigital conversion and the lookup table being generated for
+ *  the probe at build time. The temperature is interpolated within the
+ *  segment of the table using the precomputed slope, so no division
+ *  is required.
+ * The correction of temperature is not applied here.
+ * @param val
+ *  averaged result of conversion.
  * @return temperature in tenth of degrees of Celsius.
  */
-int getTemperature()
+static int convertTemperature (unsigned int val)
 {
-    unsigned int val = averaged >> ADC_AVERAGING_BITS;
-    unsigned char rightBound = ADC_RAW_TABLE_SIZE;
-    unsigned char leftBound = 0;
+    unsigned char seg = val >> NTC_SEGMENT_BITS;
+
+    return ntcBase[seg] - (int) ( ( (val & NTC_SEGMENT_MASK) * ntcSlope[seg]) >> NTC_SLOPE_SHIFT);
+}
+
+/**
+ * @brief Configures thresholds of the analog watchdog. The lookup table
+ *  is searched backwards for the lowest result of conversion which
+ *  still corresponds to a temperature below PARAM_MAX_TEMPERATURE.
+ *  Since the temperature decreases as the result grows, any result
+ *  below the low threshold means overheating and any result above
+ *  the high threshold means the sensor is disconnected.
+ */
+static void setupWatchdog()
+{
+    unsigned int low = 0, high = (1 << ADC_RESULT_BITS) - 1, mid;
+
+    watchdogLimit = getParamById (PARAM_MAX_TEMPERATURE) * 10
+                    - getParamById (PARAM_TEMPERATURE_CORRECTION);
 
-    // search through the rawAdc lookup table
-    while ( (rightBound - leftBound) > 1) {
-        unsigned char midId = (leftBound + rightBound) >> 1;
+    // Binary search for the first result below the limit
+    while (low < high) {
+        mid = (low + high) >> 1;
 
-        if (val > rawAdc[midId]) {
-            rightBound = midId;
+        if (convertTemperature (mid) < watchdogLimit) {
+            high = mid;
         } else {
-            leftBound = midId;
+            low = mid + 1;
         }
     }
 
-    // reusing the "val" for storing an intermediate result
-    if (val >= rawAdc[leftBound]) {
-        val = leftBound * 10;
+    low >>= ADC_RESULT_BITS - 10;
+    ADC_LTRH = (unsigned char) (low >> 2);
+    ADC_LTRL = (unsigned char) low & 0x03;
+    ADC_HTRH = (unsigned char) (ADC_SENSOR_OPEN >> 2);
+    ADC_HTRL = ADC_SENSOR_OPEN & 0x03;
+}
+
+/**
+ * @brief Reads the burst of samples from data buffer registers and
+ *  sorts it. Rejects the lowest and the highest samples and sums up
+ *  the rest.
+ * @return oversampled 12-bit result.
+ */
+static unsigned int readBurst()
+{
+    unsigned int buffer[ADC_BURST_SIZE], val;
+    unsigned char i, j;
+
+    for (i = 0; i < ADC_BURST_SIZE; i++) {
+        val = ADC_DBxR[i * 2] << 2;
+        val |= ADC_DBxR[i * 2 + 1];
+
+        // Insertion sort
+        for (j = i; j > 0 && buffer[j - 1] > val; j--) {
+            buffer[j] = buffer[j - 1];
+        }
+
+        buffer[j] = val;
+    }
+
+    result = buffer[ADC_BURST_SIZE / 2];
+
+    for (i = 1, val = 0; i < ADC_BURST_SIZE - 1; i++) {
+        val += buffer[i];
+    }
+
+    return val >> (ADC_BURST_EXTRA_BITS - (ADC_RESULT_BITS - 10) );
+}
+
+/**
+ * @brief Adaptive exponential filter in 16-bit fixed point. Large
+ *  deviation from the filtered value is followed with the short time
+ *  constant, the small one is smoothed with the long time constant.
+ * @param val
+ *  12-bit result of conversion.
+ * @return filtered 12-bit result.
+ */
+static unsigned int filterSample (unsigned int val)
+{
+    unsigned int delta;
+    unsigned char shift;
+
+    val <<= ADC_FILTER_FRACTION_BITS;
+
+    if (!filterSeeded) {
+        filtered = val;
+        filterSeeded = true;
+        return filtered >> ADC_FILTER_FRACTION_BITS;
+    }
+
+    if (val > filtered) {
+        delta = val - filtered;
+    } else {
+        delta = filtered - val;
+    }
+
+    if (delta > (ADC_FILTER_STEP << ADC_FILTER_FRACTION_BITS) ) {
+        shift = getParamById (PARAM_FILTER_FAST);
     } else {
-        val = (rightBound * 10) - ( (val - rawAdc[rightBound]) * 10)
-              / (rawAdc[leftBound] - rawAdc[rightBound]);
+        shift = getParamById (PARAM_FILTER_SLOW);
     }
 
-    // Final calculation and correction
-    return ADC_RAW_TABLE_BASE_TEMP + val + getParamById (PARAM_TEMPERATURE_CORRECTION);
+    // Rounding to the nearest keeps the filter from being biased
+    delta = (delta + ( (1 << shift) >> 1) ) >> shift;
+
+    if (val > filtered) {
+        filtered += delta;
+    } else {
+        filtered -= delta;
+    }
+
+    return filtered >> ADC_FILTER_FRACTION_BITS;
+}
+
+/**
+ * @brief Converts the new burst into temperature when it is available.
+ *  This function is being called from the main loop after the end of
+ *  conversion.
+ */
+void refreshTemperature()
+{
+    unsigned int val;
+    int last = temperature;
+
+    if (convertedCount == sampleCount) {
+        return;
+    }
+
+    convertedCount = sampleCount;
+    val = readBurst();
+
+    // Follow the changes of parameters
+    if (watchdogLimit != getParamById (PARAM_MAX_TEMPERATURE) * 10
+            - getParamById (PARAM_TEMPERATURE_CORRECTION) ) {
+        setupWatchdog();
+    }
+
+    sample = filterSample (val);
+    // Single 16-bit store, so readers never see a half updated value.
+    temperature = convertTemperature (sample)
+                  + getParamById (PARAM_TEMPERATURE_CORRECTION);
+    generation++;
+
+    if (temperature != last) {
+        markUiDirty (UI_SOURCE_TEMPERATURE);
+    }
+}
+
+/**
+ * @brief Gets the temperature converted from the last sample.
+ * @return temperature in tenth of degrees of Celsius.
+ */
+int getTemperature()
+{
+    return temperature;
+}
+
+/**
+ * @brief Gets generation of the temperature value. It is changed every
+ *  time a new temperature value is available.
+ * @return generation counter.
+ */
+unsigned char getTemperatureGeneration()
+{
+    return generation;
 }
 
 /**
  * @brief This function is ADC's interrupt request handler
- *  so keep it extremely small and fast.
+ *  so keep it extremely small and fast. It is requested when the data
+ *  buffer is full, the samples are processed later in the main loop.
+ *  It is also requested by the analog watchdog, in which case the relay
+ *  is tripped immediately.
  */
 void ADC1_EOC_handler() __interrupt (22)
 {
-    result = ADC_DRH << 2;
-    result |= ADC_DRL;
-    ADC_CSR &= ~0x80;   // reset EOC
+    unsigned char i, fault;
 
-    // Averaging result
-    if (averaged == 0) {
-        averaged = result << ADC_AVERAGING_BITS;
-    } else {
-        averaged += result - (averaged >> ADC_AVERAGING_BITS);
+    if (ADC_CSR & 0x40) {
+        fault = RELAY_FAULT_OVERHEAT;
+
+        for (i = 0; i < ADC_BURST_SIZE * 2; i += 2) {
+            if (ADC_DBxR[i] >= ADC_HTRH) {
+                fault = RELAY_FAULT_SENSOR;
+            }
+        }
+
+        tripRelay (fault);
+        ADC_AWSRH = 0;
+        ADC_AWSRL = 0;
+        ADC_CSR &= ~0x40;   // reset AWD
+    }
+
+    if (ADC_CSR & 0x80) {
+        ADC_CR1 &= ~0x02;   // stop continuous conversion
+        ADC_CSR &= ~0x80;   // reset EOC
+        sampleCount++;
     }
 }
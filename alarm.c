@@ -0,0 +1,161 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Alarm pattern engine.
+ * Alarms are made audible by buzzing the relay. Every pattern is a table
+ * of steps being played repeatedly. A step is either a buzz, when the
+ * relay is switched on every ALARM_BUZZ_PERIOD, or a silence, when the
+ * relay is kept in its safe state.
+ * The TIM2 update interrupt (13) is requested once per period of buzz
+ * and only once per silence, the timer is stopped while no alarm is
+ * being played. The timer counts at about 1 kHz.
+ * Distinct alarms of faults are not possible on this board: it has no
+ * buzzer and the relay is the only source of sound, so buzzing would power
+ * the load in bursts while the relay should stay in its safe state. Faults
+ * are only shown on the display, the fault view scrolls the text of the
+ * latched fault until a button is pushed.
+ */
+
+#include "alarm.h"
+#include "stm8s003/clock.h"
+#include "stm8s003/timer.h"
+#include "params.h"
+#include "relay.h"
+
+// Prescaler of TIM2 to get ~1 kHz from 16 MHz (2^14)
+#define ALARM_PRESCALER     14
+// Period of relay switching while buzzing in timer counts
+#define ALARM_BUZZ_PERIOD   2
+// Flag of step being a buzz
+#define ALARM_BUZZ          0x8000
+#define ALARM_DURATION_MASK 0x7FFF
+
+/* Steps of patterns in milliseconds, zero ends the pattern. */
+static const unsigned int patternEnd[] = {
+    12000, ALARM_BUZZ | 120, 0
+};
+
+/* The order corresponds to ALARM_* identifiers. */
+static const unsigned int* const patterns[] = {
+    patternEnd
+};
+
+static unsigned char alarm;
+static const unsigned int* step;
+static unsigned int toggles;
+
+/**
+ * @brief Loads the current step of pattern into the timer.
+ */
+static void loadStep()
+{
+    unsigned int duration;
+
+    if (*step == 0) {
+        step = patterns[alarm - 1];
+    }
+
+    duration = *step & ALARM_DURATION_MASK;
+
+    if (*step & ALARM_BUZZ) {
+        // Ensure that relay is off before buzzing.
+        setRelay (false);
+        toggles = duration / ALARM_BUZZ_PERIOD;
+        duration = ALARM_BUZZ_PERIOD;
+    } else {
+        setRelay (getParamById (PARAM_RELAY_MODE) );
+        toggles = 0;
+    }
+
+    // The prescaler follows the divider of master clock (HSIDIV)
+    TIM2_PSCR = ALARM_PRESCALER - ( (CLK_CKDIVR >> 3) & 0x03);
+    TIM2_ARRH = (unsigned char) (duration >> 8);
+    TIM2_ARRL = (unsigned char) duration;
+    TIM2_EGR = 0x01;    // Reload prescaler and counter (UG)
+    step++;
+}
+
+/**
+ * @brief Initialize TIM2 to request update interrupt on overflow only.
+ */
+void initAlarm()
+{
+    alarm = ALARM_NONE;
+    TIM2_CR1 = 0x04;    // Update request source (URS)
+    TIM2_IER = 0x01;    // Update interrupt enable (UIE)
+}
+
+/**
+ * @brief Starts playing the pattern repeatedly. The pattern being played
+ *  already is not restarted.
+ * @param id - one of ALARM_* identifiers.
+ */
+void startAlarm (unsigned char id)
+{
+    if (id == alarm) {
+        return;
+    }
+
+    if (id == ALARM_NONE) {
+        stopAlarm();
+        return;
+    }
+
+    TIM2_CR1 &= ~0x01;
+    alarm = id;
+    step = patterns[id - 1];
+    loadStep();
+    TIM2_SR1 &= ~0x01;
+    TIM2_CR1 |= 0x01;
+}
+
+/**
+ * @brief Stops the timer, so no interrupt is requested while idle.
+ */
+void stopAlarm()
+{
+    TIM2_CR1 &= ~0x01;
+    TIM2_SR1 &= ~0x01;
+    alarm = ALARM_NONE;
+}
+
+/**
+ * @brief Gets the alarm being played.
+ * @return one of ALARM_* identifiers.
+ */
+unsigned char getAlarm()
+{
+    return alarm;
+}
+
+/**
+ * @brief This function is timer's interrupt request handler
+ *  so keep it extremely small and fast.
+ */
+void TIM2_UPD_handler() __interrupt (13)
+{
+    TIM2_SR1 &= ~0x01;
+
+    if (toggles > 0) {
+        switchRelay();
+        toggles--;
+        return;
+    }
+
+    loadStep();
+}
@@ -0,0 +1,218 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Relay-feedback auto-tuning of hysteresis and switching delay.
+ * The relay is switched around PARAM_THRESHOLD with a narrow band, so the
+ * temperature oscillates. After the warm-up the period and the dead times
+ * of AUTOTUNE_CYCLES oscillations are measured. The dead time is the time
+ * from the switch of relay until the temperature turns back. A single
+ * oscillation is the least a relay test could measure, so the run takes
+ * the warm-up plus one period. AUTOTUNE_TIMEOUT only aborts a run which
+ * never oscillates.
+ * The period consists of two dead times, which don't depend on the
+ * hysteresis, and of the travel across the band, which grows in
+ * proportion to it. So the smallest hysteresis which keeps the period
+ * above 1 / AUTOTUNE_CYCLES_PER_HOUR is calculated. When the maximum hysteresis
+ * is not enough, the rest is covered by the switching delay.
+ */
+
+#include "autotune.h"
+#include "params.h"
+#include "timer.h"
+#include "ui.h"
+
+// Half of the band of relay oscillation in tenth of degrees of Celsius
+#define AUTOTUNE_BAND               2
+// Number of measured oscillations after the warm-up
+#define AUTOTUNE_CYCLES             1
+// Budget of relay cycles
+#define AUTOTUNE_CYCLES_PER_HOUR    6
+// Auto-tuning is aborted when it takes longer (in seconds)
+#define AUTOTUNE_TIMEOUT            14400
+// Seconds per unit of PARAM_RELAY_DELAY (128 calls of refreshRelay)
+#define AUTOTUNE_DELAY_UNIT         66
+// PARAM_RELAY_HYSTERESIS is stored in 1/8 of tenth of degree
+#define AUTOTUNE_HYSTERESIS_BITS    3
+#define AUTOTUNE_STAGE_WARMUP       1
+
+static unsigned char stage;
+static bool relayOn;
+static unsigned long startTime;
+static unsigned long switchTime;
+static unsigned long cycleStart;
+static int extremum;
+static unsigned long extremumTime;
+/* Sums of measurements over all cycles */
+static unsigned int sumPeriod;
+static unsigned int sumDeadTime;
+
+/**
+ * @brief Initialize auto-tuning in stopped state.
+ */
+void initAutotune()
+{
+    stage = 0;
+}
+
+/**
+ * @brief Starts auto-tuning with the warm-up.
+ */
+void startAutotune()
+{
+    stage = AUTOTUNE_STAGE_WARMUP;
+    relayOn = true;
+    startTime = switchTime = cycleStart = extremumTime = getUptime();
+    extremum = 0;
+    sumPeriod = sumDeadTime = 0;
+    markUiDirty (UI_SOURCE_CONTROL);
+}
+
+/**
+ * @brief Stops auto-tuning without changing parameters.
+ */
+void stopAutotune()
+{
+    stage = 0;
+    markUiDirty (UI_SOURCE_CONTROL);
+}
+
+/**
+ * @brief Checks whether auto-tuning is running.
+ * @return true when running.
+ */
+bool isAutotune()
+{
+    return stage != 0;
+}
+
+/**
+ * @brief Gets progress of auto-tuning.
+ * @return 0 - stopped, 1 - warm-up, 2 and more - number of measured
+ *  oscillation + 2.
+ */
+unsigned char getAutotuneStage()
+{
+    return stage;
+}
+
+/**
+ * @brief Calculates and stores the hysteresis and the switching delay
+ *  from the measurements.
+ */
+static void finishAutotune()
+{
+    long period = sumPeriod / AUTOTUNE_CYCLES;
+    // Two dead times are measured in every oscillation
+    long dead = sumDeadTime / AUTOTUNE_CYCLES;
+    long travel = period - dead;
+    long target = 3600 / AUTOTUNE_CYCLES_PER_HOUR;
+    long hysteresis, needed;
+    int delay = 0;
+
+    stopAutotune();
+
+    if (travel <= 0) {
+        return;
+    }
+
+    // The travel grows in proportion to the band, the dead time stays
+    hysteresis = ( (target - dead) * (AUTOTUNE_BAND << AUTOTUNE_HYSTERESIS_BITS) + travel - 1)
+                 / travel;
+
+    if (hysteresis < getParamMin (PARAM_RELAY_HYSTERESIS) ) {
+        hysteresis = getParamMin (PARAM_RELAY_HYSTERESIS);
+    } else if (hysteresis > getParamMax (PARAM_RELAY_HYSTERESIS) ) {
+        hysteresis = getParamMax (PARAM_RELAY_HYSTERESIS);
+        // The rest of the period is covered by delay at every switch
+        needed = target - dead
+                 - travel * hysteresis / (AUTOTUNE_BAND << AUTOTUNE_HYSTERESIS_BITS);
+
+        if (needed > 0) {
+            delay = (int) ( (needed + 2 * AUTOTUNE_DELAY_UNIT - 1) / (2 * AUTOTUNE_DELAY_UNIT) );
+        }
+
+        if (delay > getParamMax (PARAM_RELAY_DELAY) ) {
+            delay = getParamMax (PARAM_RELAY_DELAY);
+        }
+    }
+
+    setParamById (PARAM_RELAY_HYSTERESIS, (int) hysteresis);
+    setParamById (PARAM_RELAY_DELAY, delay);
+    storeParams();
+}
+
+/**
+ * @brief Makes a step of relay oscillation. This function is being called
+ *  from refreshRelay() instead of regular control.
+ * @param error
+ *  deviation from PARAM_THRESHOLD in tenth of degrees of Celsius, being
+ *  positive when the relay should be on.
+ * @return state of relay: true - on, false - off.
+ */
+bool refreshAutotune (int error)
+{
+    unsigned long now = getUptime();
+
+    if (now - startTime > AUTOTUNE_TIMEOUT) {
+        stopAutotune();
+        return false;
+    }
+
+    if (relayOn) {
+        // The error keeps growing until the heat reaches the sensor
+        if (error > extremum) {
+            extremum = error;
+            extremumTime = now;
+        }
+
+        if (error < -AUTOTUNE_BAND) {
+            if (stage > AUTOTUNE_STAGE_WARMUP) {
+                sumDeadTime += extremumTime - switchTime;
+            }
+
+            relayOn = false;
+            switchTime = extremumTime = now;
+            extremum = error;
+        }
+    } else {
+        if (error < extremum) {
+            extremum = error;
+            extremumTime = now;
+        }
+
+        if (error > AUTOTUNE_BAND) {
+            if (stage > AUTOTUNE_STAGE_WARMUP) {
+                sumDeadTime += extremumTime - switchTime;
+                sumPeriod += now - cycleStart;
+            }
+
+            relayOn = true;
+            switchTime = extremumTime = cycleStart = now;
+            extremum = error;
+            stage++;
+            markUiDirty (UI_SOURCE_CONTROL);
+
+            if (stage > AUTOTUNE_STAGE_WARMUP + AUTOTUNE_CYCLES) {
+                finishAutotune();
+                return false;
+            }
+        }
+    }
+
+    return relayOn;
+}
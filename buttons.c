@@ -18,10 +18,22 @@
 /**
  * Control functions for buttons.
  * The EXTI2 interrupt (5) is used to get signal on changing buttons state.
+ * The first edge masks the interrupt of buttons, so the bouncing of
+ * contacts doesn't produce a storm of interrupts. The state of buttons is
+ * then sampled on every tick and it is confirmed when it stays the same
+ * for BUTTONS_SETTLE_TICKS. Events are posted for the confirmed changes
+ * and the interrupt is unmasked again. A change during the settling is
+ * not signaled by the interrupt, so the state is sampled once more after
+ * unmasking and the settling is restarted when it differs.
+ * The settling time is fixed at build, "make ButtonsSettleTicks=N" after
+ * "make clean" changes it. While the display sleeps a timer's interrupt
+ * stands for four ticks, but tickButtons() counts interrupts, so the
+ * settling takes four times longer then.
  */
 
 #include "buttons.h"
 #include "stm8s003/gpio.h"
+#include "events.h"
 #include "menu.h"
 
 /* Definition for buttons */
@@ -33,9 +45,20 @@
 #define BUTTON2_BIT    0x10
 // PC.5
 #define BUTTON3_BIT    0x20
+#define BUTTONS_MASK   (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT)
+// Ticks the state of buttons should be stable to be confirmed (10 ms)
+#ifndef BUTTONS_SETTLE_TICKS
+#define BUTTONS_SETTLE_TICKS   5
+#endif
+
+#define BUTTONS_SAMPLE()    (~BUTTONS_PORT & BUTTONS_MASK)
 
 static unsigned char status;
 static unsigned char diff;
+/* The state of buttons on the previous tick while settling. */
+static unsigned char sample;
+/* Ticks remaining until the state is confirmed, 0 - not settling. */
+static unsigned char settle;
 
 /**
  * @brief Configure approptiate pins of MCU as digital inputs. Set
@@ -44,10 +67,11 @@ static unsigned char diff;
  */
 void initButtons()
 {
-    PC_CR1 |= BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT;
-    PC_CR2 |= BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT;
-    status = ~ (BUTTONS_PORT & (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT) );
+    PC_CR1 |= BUTTONS_MASK;
+    PC_CR2 |= BUTTONS_MASK;
+    status = BUTTONS_SAMPLE();
     diff = 0;
+    settle = 0;
     EXTI_CR1 |= 0x30;   // generate interrupt on falling and rising front.
 }
 
@@ -142,35 +166,77 @@ bool isButton3()
 /**
  * @brief This function is button's interrupt request handler
  * so keep it extremely small and fast.
+ * Masks the interrupt of buttons and starts settling of their state.
  */
 void EXTI2_handler() __interrupt (5)
 {
-    unsigned char event;
-    diff = status ^ ~ (BUTTONS_PORT & (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT) );
-    status = ~ (BUTTONS_PORT & (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT) );
+    PC_CR2 &= ~BUTTONS_MASK;
+    sample = BUTTONS_SAMPLE();
+    settle = BUTTONS_SETTLE_TICKS;
+}
+
+/**
+ * @brief This function is being called during timer's interrupt
+ *  request so keep it extremely small and fast.
+ *  Samples the state of buttons while it is settling. When the state
+ *  is confirmed the events are sent to menu for every button being
+ *  changed and the interrupt of buttons is unmasked.
+ */
+void tickButtons()
+{
+    unsigned char val;
+
+    if (settle == 0) {
+        return;
+    }
+
+    val = BUTTONS_SAMPLE();
+
+    // Contacts are still bouncing
+    if (val != sample) {
+        sample = val;
+        settle = BUTTONS_SETTLE_TICKS;
+        return;
+    }
+
+    if (--settle != 0) {
+        return;
+    }
+
+    diff = status ^ val;
+    status = val;
 
-    // Send appropriate event to menu.
     if (isButton1() ) {
         if (getButton1() ) {
-            event = MENU_EVENT_PUSH_BUTTON1;
+            postEvent (MENU_EVENT_PUSH_BUTTON1);
         } else {
-            event = MENU_EVENT_RELEASE_BUTTON1;
+            postEvent (MENU_EVENT_RELEASE_BUTTON1);
         }
-    } else if (isButton2() ) {
+    }
+
+    if (isButton2() ) {
         if (getButton2() ) {
-            event = MENU_EVENT_PUSH_BUTTON2;
+            postEvent (MENU_EVENT_PUSH_BUTTON2);
         } else {
-            event = MENU_EVENT_RELEASE_BUTTON2;
+            postEvent (MENU_EVENT_RELEASE_BUTTON2);
         }
-    } else if (isButton3() ) {
+    }
+
+    if (isButton3() ) {
         if (getButton3() ) {
-            event = MENU_EVENT_PUSH_BUTTON3;
+            postEvent (MENU_EVENT_PUSH_BUTTON3);
         } else {
-            event = MENU_EVENT_RELEASE_BUTTON3;
+            postEvent (MENU_EVENT_RELEASE_BUTTON3);
         }
-    } else {
-        return;
     }
 
-    feedMenu (event);
+    PC_CR2 |= BUTTONS_MASK;
+    val = BUTTONS_SAMPLE();
+
+    // The state was changed before the interrupt was unmasked
+    if (val != status) {
+        PC_CR2 &= ~BUTTONS_MASK;
+        sample = val;
+        settle = BUTTONS_SETTLE_TICKS;
+    }
 }
@@ -17,10 +17,24 @@
 
 /**
  * Control functions for the seven-segment display (SSD).
+ * For every digit the complete values of GPIO ports are precomputed into
+ * a frame, so the refresh only writes them. Frames are double buffered:
+ * a new frame is composed in the back buffer and the buffers are swapped
+ * by refreshDisplay() at digit 0, so a partially updated frame is never
+ * shown.
+ * The brightness is controlled by the time every digit is lit within the
+ * tick. Unless the brightness is full, TIM1 is started in one-pulse mode
+ * after the digit is enabled and its update interrupt (11) disables the
+ * digit. The display is dimmed when no button is pushed for a while and
+ * it is blanked later, so the power manager could slow down the clock.
+ * Strings are converted into the buffer of glyphs once, so the steps of
+ * animation (scrolling, alternation of pages and blinking) only copy
+ * three glyphs from it.
  */
 
 #include "display.h"
 #include "stm8s003/gpio.h"
+#include "stm8s003/timer.h"
 
 /* Definitions for display */
 // Port A controls segments: B, F
@@ -64,19 +78,130 @@
 #define SSD_DIGIT_2_BIT     0x20
 // PD.4
 #define SSD_DIGIT_3_BIT     0x10
-
-const unsigned char Hex2CharMap[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A',
-                                     'B', 'C', 'D', 'E', 'F'
-                                    };
+// Digits are enabled by low level
+#define SSD_DIGITS_12_OFF   (SSD_DIGIT_1_BIT | SSD_DIGIT_2_BIT)
+
+// Brightness with the digit being lit during the whole tick
+#define SSD_BRIGHTNESS_MAX  8
+// Brightness after the period of inactivity
+#define SSD_BRIGHTNESS_DIM  2
+// Ticks without pushing a button before the display is dimmed (1 min)
+#define SSD_DIM_TICKS       30000
+// Ticks without pushing a button before the display is blanked (2 min)
+#define SSD_SLEEP_TICKS     60000
+// Prescaler of TIM1 to count microseconds at 16 MHz
+#define SSD_TIMER_PRESCALER 15
+
+// Size of glyph buffer being animated
+#define SSD_GLYPHS_MAX      12
+/* Modes of animation */
+#define SSD_ANIMATE_NONE    0
+#define SSD_ANIMATE_SCROLL  1
+#define SSD_ANIMATE_PAGES   2
+// Steps of animation per scroll, page and blink
+#define SSD_SCROLL_STEPS    4
+#define SSD_PAGE_STEPS      64
+#define SSD_BLINK_STEPS     8
+
+/* Values of GPIO ports to show one digit. Port A is shared with the relay,
+   so only the bits of segments are written there. The rest of pins of
+   ports B, C and D are inputs or not used. */
+struct displayFrame {
+    unsigned char bf;
+    unsigned char digits12;
+    unsigned char cg;
+    unsigned char aedp;
+};
+
+/* Digit selection bits for digits 0..2 */
+static const unsigned char digitSelect12[] = {
+    SSD_DIGIT_2_BIT, SSD_DIGIT_1_BIT, SSD_DIGITS_12_OFF
+};
+static const unsigned char digitSelect3[] = {
+    SSD_DIGIT_3_BIT, SSD_DIGIT_3_BIT, 0
+};
+
+/* Segments of the font, the order is the common one for 7-segment fonts */
+#define FONT_SEG_A          0x01
+#define FONT_SEG_B          0x02
+#define FONT_SEG_C          0x04
+#define FONT_SEG_D          0x08
+#define FONT_SEG_E          0x10
+#define FONT_SEG_F          0x20
+#define FONT_SEG_G          0x40
+// The range of ASCII characters being covered by the font
+#define FONT_FIRST_CHAR     0x20
+#define FONT_LAST_CHAR      0x7F
+
+/* Glyphs of ASCII characters from FONT_FIRST_CHAR to FONT_LAST_CHAR.
+   The decimal point is controlled separately. */
+#define FONT_GLYPHS(G) \
+    G (0x00) /* ' '  */ G (0x06) /* '!'  */ G (0x22) /* '"'  */ G (0x7E) /* '#'  */ \
+    G (0x6D) /* '$'  */ G (0x52) /* '%'  */ G (0x46) /* '&'  */ G (0x20) /* '\'' */ \
+    G (0x29) /* '('  */ G (0x0B) /* ')'  */ G (0x21) /* '*'  */ G (0x70) /* '+'  */ \
+    G (0x10) /* ','  */ G (0x40) /* '-'  */ G (0x00) /* '.'  */ G (0x52) /* '/'  */ \
+    G (0x3F) /* '0'  */ G (0x06) /* '1'  */ G (0x5B) /* '2'  */ G (0x4F) /* '3'  */ \
+    G (0x66) /* '4'  */ G (0x6D) /* '5'  */ G (0x7D) /* '6'  */ G (0x07) /* '7'  */ \
+    G (0x7F) /* '8'  */ G (0x6F) /* '9'  */ G (0x09) /* ':'  */ G (0x0D) /* ';'  */ \
+    G (0x61) /* '<'  */ G (0x48) /* '='  */ G (0x43) /* '>'  */ G (0x53) /* '?'  */ \
+    G (0x5F) /* '@'  */ G (0x77) /* 'A'  */ G (0x7C) /* 'B'  */ G (0x39) /* 'C'  */ \
+    G (0x5E) /* 'D'  */ G (0x79) /* 'E'  */ G (0x71) /* 'F'  */ G (0x3D) /* 'G'  */ \
+    G (0x76) /* 'H'  */ G (0x30) /* 'I'  */ G (0x1E) /* 'J'  */ G (0x75) /* 'K'  */ \
+    G (0x38) /* 'L'  */ G (0x15) /* 'M'  */ G (0x37) /* 'N'  */ G (0x3F) /* 'O'  */ \
+    G (0x73) /* 'P'  */ G (0x6B) /* 'Q'  */ G (0x31) /* 'R'  */ G (0x6D) /* 'S'  */ \
+    G (0x78) /* 'T'  */ G (0x3E) /* 'U'  */ G (0x3E) /* 'V'  */ G (0x2A) /* 'W'  */ \
+    G (0x76) /* 'X'  */ G (0x6E) /* 'Y'  */ G (0x5B) /* 'Z'  */ G (0x39) /* '['  */ \
+    G (0x64) /* '\\' */ G (0x0F) /* ']'  */ G (0x23) /* '^'  */ G (0x08) /* '_'  */ \
+    G (0x02) /* '`'  */ G (0x5F) /* 'a'  */ G (0x7C) /* 'b'  */ G (0x58) /* 'c'  */ \
+    G (0x5E) /* 'd'  */ G (0x7B) /* 'e'  */ G (0x71) /* 'f'  */ G (0x6F) /* 'g'  */ \
+    G (0x74) /* 'h'  */ G (0x10) /* 'i'  */ G (0x0C) /* 'j'  */ G (0x75) /* 'k'  */ \
+    G (0x30) /* 'l'  */ G (0x14) /* 'm'  */ G (0x54) /* 'n'  */ G (0x5C) /* 'o'  */ \
+    G (0x73) /* 'p'  */ G (0x67) /* 'q'  */ G (0x50) /* 'r'  */ G (0x6D) /* 's'  */ \
+    G (0x78) /* 't'  */ G (0x1C) /* 'u'  */ G (0x1C) /* 'v'  */ G (0x14) /* 'w'  */ \
+    G (0x76) /* 'x'  */ G (0x6E) /* 'y'  */ G (0x5B) /* 'z'  */ G (0x46) /* '{'  */ \
+    G (0x30) /* '|'  */ G (0x70) /* '}'  */ G (0x01) /* '~'  */ G (0x00) /* DEL  */
+
+/* Splitting of glyph into bits of ports A and C, and port D */
+#define FONT_PORT_AC(S)     ( ( (S) & FONT_SEG_B ? SSD_SEG_B_BIT : 0) \
+                            | ( (S) & FONT_SEG_C ? SSD_SEG_C_BIT : 0) \
+                            | ( (S) & FONT_SEG_F ? SSD_SEG_F_BIT : 0) \
+                            | ( (S) & FONT_SEG_G ? SSD_SEG_G_BIT : 0) ),
+#define FONT_PORT_D(S)      ( ( (S) & FONT_SEG_A ? SSD_SEG_A_BIT : 0) \
+                            | ( (S) & FONT_SEG_D ? SSD_SEG_D_BIT : 0) \
+                            | ( (S) & FONT_SEG_E ? SSD_SEG_E_BIT : 0) ),
+
+static const unsigned char fontAC[] = {
+    FONT_GLYPHS (FONT_PORT_AC)
+};
+static const unsigned char fontD[] = {
+    FONT_GLYPHS (FONT_PORT_D)
+};
 
 static unsigned char activeDigitId;
 static unsigned char displayAC[3];
 static unsigned char displayD[3];
+static struct displayFrame frames[2][3];
+/* Time in microseconds every digit is lit within 2 ms tick for brightness
+   levels from 1 to SSD_BRIGHTNESS_MAX - 1. */
+static const unsigned int brightnessOnTime[] = {20, 50, 100, 200, 400, 800, 1400};
+static unsigned char brightness;
+static unsigned int idleTicks;
+/* Glyphs being shown or animated */
+static unsigned char glyphAC[SSD_GLYPHS_MAX];
+static unsigned char glyphD[SSD_GLYPHS_MAX];
+static unsigned char glyphCount;
+static unsigned char animation;
+static unsigned char animationPos;
+static unsigned char animationTimer;
+static bool blink;
+static bool blinkOff;
+/* Index of the frame being shown. */
+static unsigned char front;
+/* The back frame is complete and should be shown. */
+static volatile bool pending;
+
+static void commitFrame();
 
-static void enableDigit (unsigned char);
-static void setDigit (unsigned char, unsigned char, bool);
-
-static bool displayOff;
 static bool testMode;
 
 /**
@@ -93,32 +218,66 @@ void initDisplay()
     PC_CR1 |= SSD_SEG_C_BIT | SSD_SEG_G_BIT;
     PD_DDR |= SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT | SSD_SEG_P_BIT | SSD_DIGIT_3_BIT;
     PD_CR1 |= SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT | SSD_SEG_P_BIT | SSD_DIGIT_3_BIT;
-    displayOff = false;
     activeDigitId = 0;
+    front = 0;
+    pending = false;
+    brightness = SSD_BRIGHTNESS_MAX;
+    idleTicks = 0;
+    glyphCount = 0;
+    animation = SSD_ANIMATE_NONE;
+    blink = blinkOff = false;
+    TIM1_PSCRH = 0;
+    TIM1_PSCRL = SSD_TIMER_PRESCALER;
+    TIM1_CR1 = 0x0C;    // One-pulse mode (OPM), update on overflow only (URS)
+    TIM1_IER = 0x01;    // Update interrupt enable (UIE)
     setDisplayTestMode (true, "");
 }
 
 /**
  * @brief This function is being called during timer's interrupt
  *  request so keep it extremely small and fast. During this call
- *  the data from display's buffer being used to drive appropriate
- *  GPIO pins of microcontroller.
+ *  the precomputed frame of the active digit is written to the GPIO
+ *  pins of microcontroller.
  */
 void refreshDisplay()
 {
-    enableDigit (3);
+    const struct displayFrame* frame;
+    unsigned char level;
+
+    if (activeDigitId == 0 && pending) {
+        front ^= 1;
+        pending = false;
+    }
+
+    frame = &frames[front][activeDigitId];
+
+    // Disable digits before segments are changed to avoid ghosting.
+    SSD_DIGIT_12_PORT = SSD_DIGITS_12_OFF;
+    SSD_DIGIT_3_PORT |= SSD_DIGIT_3_BIT;
 
-    if (displayOff) {
+    // Keep digits disabled while the display sleeps
+    if (idleTicks >= SSD_SLEEP_TICKS) {
         return;
     }
 
-    SSD_SEG_BF_PORT &= ~SSD_BF_PORT_MASK;
-    SSD_SEG_BF_PORT |= displayAC[activeDigitId] & SSD_BF_PORT_MASK;
-    SSD_SEG_CG_PORT &= ~SSD_CG_PORT_MASK;
-    SSD_SEG_CG_PORT |= displayAC[activeDigitId] & SSD_CG_PORT_MASK;
-    SSD_SEG_AEDP_PORT &= ~SSD_AEDP_PORT_MASK;
-    SSD_SEG_AEDP_PORT |= displayD[activeDigitId];
-    enableDigit (activeDigitId);
+    SSD_SEG_BF_PORT = (SSD_SEG_BF_PORT & ~SSD_BF_PORT_MASK) | frame->bf;
+    SSD_SEG_CG_PORT = frame->cg;
+    SSD_SEG_AEDP_PORT = frame->aedp;
+    SSD_DIGIT_12_PORT = frame->digits12;
+    level = brightness;
+
+    idleTicks++;
+
+    if (idleTicks >= SSD_DIM_TICKS && level > SSD_BRIGHTNESS_DIM) {
+        level = SSD_BRIGHTNESS_DIM;
+    }
+
+    // Start the pulse, the digit is disabled at its end
+    if (level < SSD_BRIGHTNESS_MAX) {
+        TIM1_ARRH = (unsigned char) (brightnessOnTime[level - 1] >> 8);
+        TIM1_ARRL = (unsigned char) brightnessOnTime[level - 1];
+        TIM1_CR1 |= 0x01;
+    }
 
     if (activeDigitId > 1) {
         activeDigitId = 0;
@@ -127,6 +286,49 @@ void refreshDisplay()
     }
 }
 
+/**
+ * @brief This function is timer's interrupt request handler being
+ *  requested at the end of the pulse, so keep it extremely small and
+ *  fast. Disables all digits until the next tick.
+ */
+void TIM1_UPD_handler() __interrupt (11)
+{
+    TIM1_SR1 &= ~0x01;
+    SSD_DIGIT_12_PORT = SSD_DIGITS_12_OFF;
+    SSD_DIGIT_3_PORT |= SSD_DIGIT_3_BIT;
+}
+
+/**
+ * @brief Sets brightness of display.
+ * @param val
+ *  brightness level from 1 to SSD_BRIGHTNESS_MAX (full).
+ */
+void setDisplayBrightness (unsigned char val)
+{
+    if (val > 0 && val <= SSD_BRIGHTNESS_MAX) {
+        brightness = val;
+    }
+}
+
+/**
+ * @brief Restores the brightness of display after the period of
+ *  inactivity. This function is being called when a button is pushed.
+ */
+void wakeDisplay()
+{
+    idleTicks = 0;
+}
+
+/**
+ * @brief Checks whether the display is blanked after the period of
+ *  inactivity.
+ * @return true - display sleeps, false - display is on.
+ */
+bool isDisplayAsleep()
+{
+    return idleTicks >= SSD_SLEEP_TICKS;
+}
+
 /**
  * @brief Enables/disables a test mode of SSDisplay. While in this mode
  *  the test message will be displayed and any attempts to update
@@ -147,16 +349,6 @@ void setDisplayTestMode (bool val, char* str)
     testMode = val;
 }
 
-/**
- * @brief Enable/disable display.
- * @param val
- *  value to be set: true - display off, false - display on.
- */
-void setDisplayOff (bool val)
-{
-    displayOff = val;
-}
-
 /**
  * @brief Sets dot in the buffer of display at position pointed by id
  *  to the state defined by val.
@@ -172,250 +364,281 @@ void setDisplayDot (unsigned char id, bool val)
     } else {
         displayD[id] &= ~SSD_SEG_P_BIT;
     }
+
+    commitFrame();
 }
 
 /**
- * @brief Sets symbols of given null-terminated string into display's buffer.
+ * @brief Composes the back frame from display's buffer and marks it to
+ *  be shown. The swap is held off while the frame is being composed.
+ */
+static void commitFrame()
+{
+    struct displayFrame* frame;
+    unsigned char i;
+
+    pending = false;
+    frame = frames[front ^ 1];
+
+    for (i = 0; i < 3; i++) {
+        frame[i].bf = displayAC[i] & SSD_BF_PORT_MASK;
+        frame[i].digits12 = digitSelect12[i];
+        frame[i].cg = displayAC[i] & SSD_CG_PORT_MASK;
+        frame[i].aedp = displayD[i] | digitSelect3[i];
+    }
+
+    pending = true;
+}
+
+/**
+ * @brief Sets bits of glyph buffer appropriate to given value.
+ *
+ * The list of segments as they located on display:
+ *  _2_       _1_       _0_
+ *  <A>       <A>       <A>
+ * F   B     F   B     F   B
+ *  <G>       <G>       <G>
+ * E   C     E   C     E   C
+ *  <D> (P)   <D> (P)   <D> (P)
+ *
+ * @param pos
+ *  Position within the glyph buffer.
+ * @param val
+ *  Character to be represented on SSD.
+ *  Due to limited capabilities of SSD some characters are shown in a very
+ *  schematic manner.
+ *  Accepted values are: ANY.
+ *  But only printable ASCII characters are defined. For the rest of values
+ *  the '_' symbol is shown.
+ */
+static void setGlyph (unsigned char pos, unsigned char val)
+{
+    if (val < FONT_FIRST_CHAR || val > FONT_LAST_CHAR) {
+        glyphAC[pos] = 0;
+        glyphD[pos] = SSD_SEG_D_BIT;
+    } else {
+        glyphAC[pos] = fontAC[val - FONT_FIRST_CHAR];
+        glyphD[pos] = fontD[val - FONT_FIRST_CHAR];
+    }
+}
+
+/**
+ * @brief Converts the string into glyphs. The dot following a character
+ *  is merged into the glyph of that character.
  * @param val
  *  pointer to the null-terminated string.
+ * @param pos
+ *  position within the glyph buffer to start from.
+ * @param max
+ *  maximal number of glyphs.
+ * @return number of glyphs.
  */
-void setDisplayStr (const unsigned char* val)
+static unsigned char compileStr (const unsigned char* val, unsigned char pos,
+                                 unsigned char max)
 {
-    unsigned char i, d;
+    unsigned char n = 0;
+    bool merged = true;
+
+    for (; *val != 0; val++) {
+        if (*val == '.' && !merged) {
+            glyphD[pos + n - 1] |= SSD_SEG_P_BIT;
+            merged = true;
+            continue;
+        }
+
+        if (n == max) {
+            break;
+        }
+
+        setGlyph (pos + n, *val);
+        merged = (*val == '.');
+
+        if (merged) {
+            glyphD[pos + n] |= SSD_SEG_P_BIT;
+        }
 
-    // get number of display digit(s) required to show given string.
-    for (i = 0, d = 0; * (val + i) != 0; i++, d++) {
-        if (* (val + i) == '.' && i > 0 && * (val + i - 1) != '.') d--;
+        n++;
     }
 
-    // at this point d = required digits
-    // but SSD have 3 digits only. So rest is doesn't matters.
-    if (d > 3) {
-        d = 3;
+    return n;
+}
+
+/**
+ * @brief Converts the string into the page of glyphs aligned to the right.
+ *  Characters which don't fit on display are dropped.
+ * @param val
+ *  pointer to the null-terminated string.
+ * @param pos
+ *  position of the page within the glyph buffer.
+ */
+static void compilePage (const unsigned char* val, unsigned char pos)
+{
+    unsigned char i, n = compileStr (val, pos, 3);
+
+    for (i = 3; i > 0; i--) {
+        if (i > 3 - n) {
+            glyphAC[pos + i - 1] = glyphAC[pos + i - 1 - (3 - n)];
+            glyphD[pos + i - 1] = glyphD[pos + i - 1 - (3 - n)];
+        } else {
+            glyphAC[pos + i - 1] = 0;
+            glyphD[pos + i - 1] = 0;
+        }
     }
+}
+
+/**
+ * @brief Shows three glyphs starting from the given position of the
+ *  glyph buffer. The position wraps around the end of the buffer.
+ *  When test mode is enabled the display's buffer will not be updated.
+ * @param pos
+ *  position of the leftmost digit.
+ */
+static void showGlyphs (unsigned char pos)
+{
+    unsigned char i;
 
-    // disable the digit if it is not needed.
-    for (i = 3 - d; i > 0; i--) {
-        setDigit (3 - i, ' ', false);
+    if (testMode) {
+        return;
     }
 
-    // set values for digits.
-    for (i = 0; d != 0 && *val + i != 0; i++, d--) {
-        if (* (val + i + 1) == '.') {
-            setDigit (d - 1, * (val + i), true);
-            i++;
+    for (i = 3; i > 0; i--) {
+        if (pos >= glyphCount) {
+            pos = 0;
+        }
+
+        if (blinkOff) {
+            displayAC[i - 1] = 0;
+            displayD[i - 1] = 0;
         } else {
-            setDigit (d - 1, * (val + i), false);
+            displayAC[i - 1] = glyphAC[pos];
+            displayD[i - 1] = glyphD[pos];
         }
+
+        pos++;
     }
+
+    commitFrame();
 }
 
 /**
- * @brief
- * Enable the digit with given ID on SSD and rest of digits are disabled.
- *
- * @param id
- * The ID = 0 corresponds to the right most digit on the display.
- * Accepted values are: 0, 1, 2, any other value will disable display.
+ * @brief Sets the animation and shows its first frame. The position of
+ *  animation is kept when the same animation is being updated.
+ * @param mode
+ *  one of SSD_ANIMATE_* modes.
  */
-static void enableDigit (unsigned char id)
+static void startAnimation (unsigned char mode)
 {
-    switch (id) {
-    case 0:
-        SSD_DIGIT_12_PORT &= ~SSD_DIGIT_1_BIT;
-        SSD_DIGIT_12_PORT |= SSD_DIGIT_2_BIT;
-        SSD_DIGIT_3_PORT |= SSD_DIGIT_3_BIT;
-        break;
-
-    case 1:
-        SSD_DIGIT_12_PORT &= ~SSD_DIGIT_2_BIT;
-        SSD_DIGIT_12_PORT |= SSD_DIGIT_1_BIT;
-        SSD_DIGIT_3_PORT |= SSD_DIGIT_3_BIT;
-        break;
-
-    case 2:
-        SSD_DIGIT_3_PORT &= ~SSD_DIGIT_3_BIT;
-        SSD_DIGIT_12_PORT |= SSD_DIGIT_1_BIT | SSD_DIGIT_2_BIT;
-        break;
-
-    default:
-        SSD_DIGIT_12_PORT |= SSD_DIGIT_1_BIT | SSD_DIGIT_2_BIT;
-        SSD_DIGIT_3_PORT |= SSD_DIGIT_3_BIT;
-        break;
+    if (mode != animation || animationPos >= glyphCount) {
+        animation = mode;
+        animationPos = 0;
+        animationTimer = 0;
     }
+
+    showGlyphs (animationPos);
 }
 
 /**
- * @brief Sets bits within display's buffer appropriate to given value.
- *  So this symbol will be shown on display during refreshDisplay() call.
- *  When test mode is enabled the display's buffer will not be updated.
- *
- * The list of segments as they located on display:
- *  _2_       _1_       _0_
- *  <A>       <A>       <A>
- * F   B     F   B     F   B
- *  <G>       <G>       <G>
- * E   C     E   C     E   C
- *  <D> (P)   <D> (P)   <D> (P)
- *
- * @param id
- *  Identifier of character's position on display.
- *  Accepted values are: 0, 1, 2.
+ * @brief Sets symbols of given null-terminated string into display's buffer.
  * @param val
- *  Character to be represented on SSD at position being designated by id.
- *  Due to limited capabilities of SSD some characters are shown in a very
- *  schematic manner.
- *  Accepted values are: ANY.
- *  But only actual characters are defined. For the rest of values the
- *  '_' symbol is shown.
- * @param dot
- *  Enable dot (decimal point) for the character.
- *  Accepted values true/false.
- *
+ *  pointer to the null-terminated string.
+ */
+void setDisplayStr (const unsigned char* val)
+{
+    compilePage (val, 0);
+    glyphCount = 3;
+    startAnimation (SSD_ANIMATE_NONE);
+}
+
+/**
+ * @brief Shows the string scrolling from right to left when it doesn't
+ *  fit on display.
+ * @param val
+ *  pointer to the null-terminated string.
  */
-static void setDigit (unsigned char id, unsigned char val, bool dot)
+void setDisplayScroll (const unsigned char* val)
 {
+    unsigned char i;
 
-    if (id > 2) return;
-
-    if (testMode) return;
-
-    switch (val) {
-    case '-':
-        displayAC[id] = SSD_SEG_G_BIT;
-        displayD[id] = 0;
-        break;
-
-    case ' ':
-        displayAC[id] = 0;
-        displayD[id] = 0;
-        break;
-
-    case '0':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_F_BIT | SSD_SEG_C_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case '1':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT;
-        displayD[id] = 0;
-        break;
-
-    case '2':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case '3':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT;
-        break;
-
-    case '4':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = 0;
-        break;
-
-    case '5':
-        displayAC[id] = SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT;
-        break;
-
-    case '6':
-        displayAC[id] = SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case '7':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT;
-        displayD[id] = SSD_SEG_A_BIT;
-        break;
-
-    case '8':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case '9':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT;
-        break;
-
-    case 'A':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'B':
-        displayAC[id] = SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'C':
-        displayAC[id] = SSD_SEG_F_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'D':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'E':
-        displayAC[id] = SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'F':
-        displayAC[id] = SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'H':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_C_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_E_BIT;
-        break;
-
-    case 'L':
-        displayAC[id] = SSD_SEG_F_BIT;
-        displayD[id] = SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'N':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_F_BIT | SSD_SEG_C_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'O':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_F_BIT | SSD_SEG_C_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'P':
-        displayAC[id] = SSD_SEG_B_BIT | SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'R':
-        displayAC[id] = SSD_SEG_F_BIT;
-        displayD[id] = SSD_SEG_A_BIT | SSD_SEG_E_BIT;
-        break;
-
-    case 'T':
-        displayAC[id] = SSD_SEG_F_BIT | SSD_SEG_G_BIT;
-        displayD[id] = SSD_SEG_D_BIT | SSD_SEG_E_BIT;
-        break;
-
-    default:
-        displayAC[id] = 0;
-        displayD[id] = SSD_SEG_D_BIT;
+    glyphCount = compileStr (val, 0, SSD_GLYPHS_MAX - 3);
+
+    if (glyphCount <= 3) {
+        setDisplayStr (val);
+        return;
     }
 
-    if (dot) {
-        displayD[id] |= SSD_SEG_P_BIT;
-    } else {
-        displayD[id] &= ~SSD_SEG_P_BIT;
+    // Gap between the end and the beginning of the string
+    for (i = 0; i < 3; i++) {
+        setGlyph (glyphCount++, ' ');
+    }
+
+    startAnimation (SSD_ANIMATE_SCROLL);
+}
+
+/**
+ * @brief Shows the strings one after another, each one is shown for
+ *  SSD_PAGE_STEPS steps of animation.
+ * @param pages
+ *  pointers to the null-terminated strings.
+ * @param count
+ *  number of strings.
+ */
+void setDisplayPages (const unsigned char* const* pages, unsigned char count)
+{
+    unsigned char i;
+
+    if (count > SSD_GLYPHS_MAX / 3) {
+        count = SSD_GLYPHS_MAX / 3;
+    }
+
+    for (i = 0; i < count; i++) {
+        compilePage (pages[i], i * 3);
     }
 
-    return;
+    glyphCount = count * 3;
+    startAnimation (count > 1 ? SSD_ANIMATE_PAGES : SSD_ANIMATE_NONE);
+}
+
+/**
+ * @brief Enables/disables blinking of shown symbols. The phase of
+ *  blinking is kept while symbols are being updated.
+ * @param val
+ *  true - blink, false - steady.
+ */
+void setDisplayBlink (bool val)
+{
+    blink = val;
+
+    if (!val && blinkOff) {
+        blinkOff = false;
+        showGlyphs (animationPos);
+    }
+}
+
+/**
+ * @brief Makes a step of animation. This function is being called
+ *  periodically from the main loop, the next frame is only copied from
+ *  the glyph buffer.
+ */
+void refreshAnimation()
+{
+    bool changed = false;
+
+    animationTimer++;
+
+    if (animation == SSD_ANIMATE_SCROLL && animationTimer % SSD_SCROLL_STEPS == 0) {
+        animationPos = animationPos + 1 < glyphCount ? animationPos + 1 : 0;
+        changed = true;
+    } else if (animation == SSD_ANIMATE_PAGES && animationTimer % SSD_PAGE_STEPS == 0) {
+        animationPos = animationPos + 3 < glyphCount ? animationPos + 3 : 0;
+        changed = true;
+    }
+
+    if (blink && animationTimer % SSD_BLINK_STEPS == 0) {
+        blinkOff = !blinkOff;
+        changed = true;
+    }
+
+    if (changed) {
+        showGlyphs (animationPos);
+    }
 }
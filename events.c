@@ -0,0 +1,98 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Queue of events being passed from interrupt handlers to the main loop.
+ * Events are put into the queue by interrupt handlers only and taken
+ * out of the queue by the main loop only. All interrupts have the same
+ * priority and never preempt each other, so there is a single producer
+ * and a single consumer and no locking is required. Each side changes
+ * its own one byte index only.
+ */
+
+#include "events.h"
+#include "timer.h"
+
+// Size of the queue, must be a power of 2.
+#define EVENTS_QUEUE_SIZE   16
+#define EVENTS_QUEUE_MASK   (EVENTS_QUEUE_SIZE - 1)
+
+static struct event queue[EVENTS_QUEUE_SIZE];
+/* Index of the next event to be put, changed by interrupt handlers. */
+static volatile unsigned char head;
+/* Index of the next event to be taken, changed by the main loop. */
+static volatile unsigned char tail;
+static unsigned char lost;
+
+/**
+ * @brief Initialize the queue of events.
+ */
+void initEvents()
+{
+    head = tail = 0;
+    lost = 0;
+}
+
+/**
+ * @brief Puts the event into the queue along with the current value of
+ *  ticks counter. This function should be called from interrupt
+ *  handlers only. When the queue is full the event is dropped.
+ * @param id
+ *  Identifier of the event.
+ */
+void postEvent (unsigned char id)
+{
+    unsigned char next = (head + 1) & EVENTS_QUEUE_MASK;
+
+    if (next == tail) {
+        lost++;
+        return;
+    }
+
+    queue[head].id = id;
+    queue[head].time = getTickCount();
+    head = next;
+}
+
+/**
+ * @brief Takes the oldest event out of the queue. This function should
+ *  be called from the main loop only.
+ * @param ev
+ *  Pointer to the structure where the event should be placed.
+ * @return true if the event is taken, false if the queue is empty.
+ */
+bool pollEvent (struct event* ev)
+{
+    if (tail == head) {
+        return false;
+    }
+
+    ev->id = queue[tail].id;
+    ev->time = queue[tail].time;
+    tail = (tail + 1) & EVENTS_QUEUE_MASK;
+    return true;
+}
+
+/**
+ * @brief Gets number of events being dropped because of the queue
+ *  overflow.
+ * @return number of lost events.
+ */
+unsigned char getEventsLost()
+{
+    return lost;
+}
@@ -21,6 +21,8 @@
 void initADC();
 void startADC();
 int getTemperature();
+unsigned char getTemperatureGeneration();
+void refreshTemperature();
 unsigned int getAdcResult();
 unsigned int getAdcAveraged();
 void ADC1_EOC_handler() __interrupt (22);
@@ -0,0 +1,31 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALARM_H
+#define ALARM_H
+
+/* Alarm identifiers */
+#define ALARM_NONE          0
+#define ALARM_END           1
+
+void initAlarm();
+void startAlarm (unsigned char);
+void stopAlarm();
+unsigned char getAlarm();
+void TIM2_UPD_handler() __interrupt (13);
+
+#endif
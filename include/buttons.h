@@ -33,6 +33,7 @@ bool getButton2();
 bool getButton3();
 unsigned char getButton();
 unsigned char getButtonDiff();
+void tickButtons();
 void EXTI2_handler() __interrupt (5);
 
 #endif
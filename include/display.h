@@ -27,8 +27,15 @@
 void initDisplay();
 void refreshDisplay();
 void setDisplayInt (int);
-void setDisplayOff (bool val);
 void setDisplayStr (const unsigned char*);
+void setDisplayScroll (const unsigned char*);
+void setDisplayPages (const unsigned char* const*, unsigned char);
+void setDisplayBlink (bool);
+void refreshAnimation();
 void setDisplayTestMode (bool, char* str);
+void setDisplayBrightness (unsigned char);
+void wakeDisplay();
+bool isDisplayAsleep();
+void TIM1_UPD_handler() __interrupt (11);
 
 #endif
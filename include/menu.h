@@ -34,6 +34,7 @@
 
 void initMenu();
 void refreshMenu();
+void processMenuEvents();
 unsigned char getMenuDisplay();
 void feedMenu (unsigned char event);
 
@@ -27,7 +27,21 @@
 #define PARAM_RELAY_DELAY               5
 #define PARAM_OVERHEAT_INDICATION       6
 #define PARAM_THRESHOLD                 7
+#define PARAM_FILTER_SLOW               8
 #define PARAM_FERMENTATION_TIME         9
+#define PARAM_FILTER_FAST               10
+#define PARAM_CONTROL_MODE              11
+#define PARAM_PID_KP                    12
+#define PARAM_PID_KI                    13
+#define PARAM_PID_KD                    14
+#define PARAM_PID_WINDOW                15
+/* Hidden parameters of the heater model */
+#define PARAM_MODEL_GAIN                16
+#define PARAM_MODEL_TAU                 17
+#define PARAM_MODEL_LAG                 18
+#define PARAM_BRIGHTNESS                19
+/* Number of parameters */
+#define PARAM_COUNT                     20
 
 int getParam();
 void incParam();
@@ -35,10 +49,14 @@ void decParam();
 void incParamId();
 void decParamId();
 void storeParams();
+void refreshParams();
 void initParamsEEPROM();
 unsigned char getParamId();
 int getParamById (unsigned char);
+int getParamMin (unsigned char);
+int getParamMax (unsigned char);
 void setParam (int);
+void stepParam (int);
 void setParamId (unsigned char);
 void setParamById (unsigned char, int);
 void paramToString (unsigned char, unsigned char*);
@@ -0,0 +1,33 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+/* Identifiers of modules which can request the full speed of CPU */
+#define POWER_HOLD_MENU     0x01
+/* Value of CLK_CKDIVR: fMASTER = 16 MHz, fCPU = 16 MHz */
+#define POWER_CLK_FULL      0x00
+/* Bits of CPU divider (CPUDIV) within CLK_CKDIVR */
+#define POWER_CLK_CPUDIV    0x07
+
+void initPower();
+void holdFullSpeed (unsigned char);
+void releaseFullSpeed (unsigned char);
+void enterIdle();
+
+#endif
@@ -24,10 +24,20 @@
 #define false   0
 #endif
 
+/* Fault codes latched by tripRelay() */
+#define RELAY_FAULT_NONE        0
+#define RELAY_FAULT_OVERHEAT    1
+#define RELAY_FAULT_SENSOR      2
+
 void initRelay();
-void buzzRelay ();
+void setRelay (bool on);
+void switchRelay ();
 void refreshRelay();
+void tickRelay();
 bool isRelayEnabled();
 void enableRelay (bool state);
+void tripRelay (unsigned char);
+unsigned char getRelayFault();
+void clearRelayFault();
 
 #endif
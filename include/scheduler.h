@@ -0,0 +1,42 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* Task identifiers (index within the table of tasks) */
+#define SCHED_TASK_MENU         0
+#define SCHED_TASK_ADC          1
+#define SCHED_TASK_TEMPERATURE  2
+#define SCHED_TASK_RELAY        3
+#define SCHED_TASK_PROFILE      4
+#define SCHED_TASK_DISPLAY      5
+#define SCHED_TASK_RELAY_WINDOW 6
+#define SCHED_TASK_UI           7
+#define SCHED_TASK_ANIMATION    8
+#define SCHED_TASK_BUTTONS      9
+/* Context where the task is being run */
+#define SCHED_RUN_ISR           0
+#define SCHED_RUN_MAIN          1
+
+void initScheduler();
+void tickScheduler (unsigned char);
+void runScheduledTasks();
+unsigned int getTaskOverruns (unsigned char);
+unsigned int getTaskJitter (unsigned char);
+
+#endif
@@ -25,16 +25,15 @@
 #endif
 
 void initTimer();
-void startFTimer();
-void stopFTimer();
 void resetUptime();
-bool isFTimer();
+void setTickWeight (unsigned char);
 unsigned long getUptime();
+unsigned int getTickCount();
 unsigned int getUptimeTicks();
 unsigned char getUptimeSeconds();
 unsigned char getUptimeMinutes();
 unsigned char getUptimeHours();
-unsigned char getUptimeDays();
+unsigned int getUptimeDays();
 void uptimeToString (unsigned char*, const unsigned char*);
 void TIM4_UPD_handler() __interrupt (23);
 
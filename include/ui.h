@@ -0,0 +1,33 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UI_H
+#define UI_H
+
+/* Sources of changes being shown by the user interface */
+#define UI_SOURCE_TEMPERATURE   0
+#define UI_SOURCE_CLOCK         1
+#define UI_SOURCE_MENU          2
+#define UI_SOURCE_CONTROL       3
+#define UI_SOURCE_COUNT         4
+
+void initUi();
+void markUiDirty (unsigned char);
+void tickUi();
+void refreshUi();
+
+#endif
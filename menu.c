@@ -20,48 +20,310 @@
  */
 
 #include "menu.h"
+#include "autotune.h"
 #include "buttons.h"
 #include "display.h"
+#include "events.h"
 #include "params.h"
+#include "power.h"
+#include "profile.h"
 #include "timer.h"
 #include "relay.h"
+#include "ui.h"
 
 #define MENU_1_SEC_PASSED   32
 #define MENU_3_SEC_PASSED   MENU_1_SEC_PASSED * 3
 #define MENU_5_SEC_PASSED   MENU_1_SEC_PASSED * 5
 #define MENU_AUTOINC_DELAY  MENU_1_SEC_PASSED / 8
+// Number of repeats before the step of auto-repeat is increased
+#define MENU_REPEATS_PER_STAGE  8
+
+/* States of menu. Holding button 1 is a separate state, because it
+   changes the section being displayed. */
+#define MENU_STATE_ROOT         0
+#define MENU_STATE_ROOT_HOLD    1
+#define MENU_STATE_TIMER        2
+#define MENU_STATE_TIMER_HOLD   3
+#define MENU_STATE_SELECT       4
+#define MENU_STATE_CHANGE       5
+#define MENU_STATES_COUNT       6
+// Next state of a transition which keeps the current state
+#define MENU_STATE_SAME         0xFF
+#define MENU_EVENTS_COUNT       (MENU_EVENT_CHECK_TIMER + 1)
+
+/* Transition of menu. The list of transitions for the given state and
+   event is ended by the one without guard, the first transition with
+   passed guard is taken. */
+struct menuTransition {
+    bool (*guard) ();
+    void (*action) ();
+    unsigned char next;
+};
 
-static unsigned char menuDisplay;
 static unsigned char menuState;
 /* Timer counter of menu. Being incremented on every call of refreshMenu() function.
  * Used to handle menu timeouts and handling of actions on holding a button. */
 static unsigned int timer;
 
+/* Number of repeats since the button 2 or 3 was pushed. */
+static unsigned char repeats;
+/* Steps and delays between repeats (in timer counts) of auto-repeat
+   for every stage of holding a button. */
+static const unsigned char repeatSteps[] = {1, 5, 10, 50};
+static const unsigned char repeatDelay[] = {
+    MENU_AUTOINC_DELAY, MENU_AUTOINC_DELAY - 1, MENU_AUTOINC_DELAY - 2, MENU_AUTOINC_DELAY - 3
+};
+
+/* Menu sections being displayed in every state */
+static const unsigned char stateDisplay[] = {
+    MENU_ROOT, MENU_SET_TIMER, MENU_SET_TIMER, MENU_ROOT, MENU_SELECT_PARAM, MENU_CHANGE_PARAM
+};
+
 /**
  * @brief Initialization of local variables.
  */
 void initMenu()
 {
     timer = 0;
-    menuState = menuDisplay = MENU_ROOT;
+    repeats = 0;
+    menuState = MENU_STATE_ROOT;
 }
 
 /**
  * @brief Gets menu state for displaying appropriate value on the SSD.
- * @return
+ * @return one of MENU_ROOT, MENU_SET_TIMER, MENU_SELECT_PARAM,
+ *  MENU_CHANGE_PARAM.
  */
 unsigned char getMenuDisplay()
 {
-    return menuDisplay;
+    return stateDisplay[menuState];
+}
+
+/* Guards */
+
+static bool isHeld3s()
+{
+    return timer > MENU_3_SEC_PASSED;
+}
+
+static bool isButton1Held3s()
+{
+    return getButton1() && timer > MENU_3_SEC_PASSED;
+}
+
+static bool isButton1Held5s()
+{
+    return getButton1() && timer > MENU_5_SEC_PASSED;
+}
+
+static bool isTimeout()
+{
+    return timer > MENU_5_SEC_PASSED;
+}
+
+/* Actions */
+
+static void resetTimer()
+{
+    timer = 0;
+}
+
+/**
+ * @brief Changes the value being shown in the current state.
+ * @param step - signed step of the value, only its sign is used for
+ *  selection of parameter.
+ */
+static void adjust (int step)
+{
+    if (menuState == MENU_STATE_SELECT) {
+        if (step > 0) {
+            incParamId();
+        } else {
+            decParamId();
+        }
+
+        return;
+    }
+
+    if (menuState != MENU_STATE_CHANGE) {
+        setParamId (PARAM_FERMENTATION_TIME);
+    }
+
+    stepParam (step);
+}
+
+static void stepUp()
+{
+    timer = 0;
+    repeats = 0;
+    adjust (1);
+}
+
+static void stepDown()
+{
+    timer = 0;
+    repeats = 0;
+    adjust (-1);
+}
+
+/**
+ * @brief Repeats the change of value while button 2 or 3 is being held.
+ *  The longer the button is held the larger the step and the shorter
+ *  the delay between repeats.
+ */
+static void repeatStep()
+{
+    unsigned char stage;
+    int step;
+
+    stage = repeats / MENU_REPEATS_PER_STAGE;
+
+    if (stage >= sizeof repeatSteps / sizeof repeatSteps[0]) {
+        stage = sizeof repeatSteps / sizeof repeatSteps[0] - 1;
+    }
+
+    if (timer > MENU_1_SEC_PASSED + repeatDelay[stage]) {
+        step = repeatSteps[stage];
+
+        if (getButton2() ) {
+            adjust (step);
+        } else if (getButton3() ) {
+            adjust (-step);
+        } else {
+            return;
+        }
+
+        timer = MENU_1_SEC_PASSED;
+
+        if (repeats < 0xFF) {
+            repeats++;
+        }
+    }
+}
+
+/**
+ * @brief Handles holding of buttons in root menu: buttons 2 and 3 -
+ *  start/stop auto-tuning, button 2 - enable/disable thermostat,
+ *  button 3 - start/stop fermentation timer.
+ */
+static void holdRoot()
+{
+    timer = 0;
+
+    if (getButton2() && getButton3() ) {
+        if (isAutotune() ) {
+            stopAutotune();
+        } else {
+            startAutotune();
+            enableRelay (true);
+        }
+    } else if (getButton2() ) {
+        if (isRelayEnabled() && !isFTimer() ) {
+            enableRelay (false);
+        } else {
+            enableRelay (true);
+        }
+    } else if (getButton3() ) {
+        if (isFTimer() ) {
+            stopFTimer();
+            enableRelay (false);
+        } else {
+            startFTimer();
+            enableRelay (true);
+        }
+    }
+}
+
+static void enterParams()
+{
+    timer = 0;
+    setParamId (0);
 }
 
+static void store()
+{
+    timer = 0;
+    storeParams();
+}
+
+static void leaveParams()
+{
+    timer = 0;
+    setParamId (0);
+    storeParams();
+}
+
+/* Lists of transitions */
+
+static const struct menuTransition toReset[] = {
+    {0, resetTimer, MENU_STATE_SAME}
+};
+static const struct menuTransition toStepUp[] = {
+    {0, stepUp, MENU_STATE_SAME}
+};
+static const struct menuTransition toStepDown[] = {
+    {0, stepDown, MENU_STATE_SAME}
+};
+static const struct menuTransition rootPush1[] = {
+    {0, resetTimer, MENU_STATE_ROOT_HOLD}
+};
+static const struct menuTransition rootCheck[] = {
+    {isHeld3s, holdRoot, MENU_STATE_SAME},
+    {0, 0, MENU_STATE_SAME}
+};
+static const struct menuTransition rootHoldRelease1[] = {
+    {0, resetTimer, MENU_STATE_TIMER}
+};
+static const struct menuTransition rootHoldCheck[] = {
+    {isButton1Held3s, enterParams, MENU_STATE_SELECT},
+    {0, 0, MENU_STATE_SAME}
+};
+static const struct menuTransition timerPush1[] = {
+    {0, resetTimer, MENU_STATE_TIMER_HOLD}
+};
+static const struct menuTransition timerCheck[] = {
+    {isTimeout, store, MENU_STATE_ROOT},
+    {0, repeatStep, MENU_STATE_SAME}
+};
+static const struct menuTransition timerHoldRelease1[] = {
+    {0, store, MENU_STATE_ROOT}
+};
+static const struct menuTransition timerHoldCheck[] = {
+    {isButton1Held5s, enterParams, MENU_STATE_SELECT},
+    {isTimeout, store, MENU_STATE_ROOT},
+    {0, repeatStep, MENU_STATE_SAME}
+};
+static const struct menuTransition selectPush1[] = {
+    {0, resetTimer, MENU_STATE_CHANGE}
+};
+static const struct menuTransition selectCheck[] = {
+    {isTimeout, leaveParams, MENU_STATE_ROOT},
+    {0, repeatStep, MENU_STATE_SAME}
+};
+static const struct menuTransition changePush1[] = {
+    {0, resetTimer, MENU_STATE_SELECT}
+};
+static const struct menuTransition changeCheck[] = {
+    {isButton1Held3s, resetTimer, MENU_STATE_SELECT},
+    {isTimeout, store, MENU_STATE_ROOT},
+    {0, repeatStep, MENU_STATE_SAME}
+};
+
+/* Transitions for every state and event, the order of events is:
+   push button 1, 2, 3, release button 1, 2, 3, check timer. */
+static const struct menuTransition* const transitions[MENU_STATES_COUNT][MENU_EVENTS_COUNT] = {
+    {rootPush1, toReset, toReset, 0, 0, 0, rootCheck},
+    {0, 0, 0, rootHoldRelease1, 0, 0, rootHoldCheck},
+    {timerPush1, toStepUp, toStepDown, toReset, toReset, toReset, timerCheck},
+    {0, toStepUp, toStepDown, timerHoldRelease1, toReset, toReset, timerHoldCheck},
+    {selectPush1, toStepUp, toStepDown, toReset, toReset, toReset, selectCheck},
+    {changePush1, toStepUp, toStepDown, toReset, toReset, toReset, changeCheck}
+};
+
 /**
- * @brief Updating state of application's menu and displaying info when new
- *  event is received. Possible states of menu and displaying are:
- *  MENU_ROOT
- *  MENU_SELECT_PARAM
- *  MENU_CHANGE_PARAM
- *  MENU_SET_TIMER
+ * @brief Updating state of application's menu when new event is
+ *  received. The transition is looked up in the table by the current
+ *  state and the event, so the dispatch takes constant time.
  *
  * @param event is one of:
  *  MENU_EVENT_PUSH_BUTTON1
@@ -74,244 +336,69 @@ unsigned char getMenuDisplay()
  */
 void feedMenu (unsigned char event)
 {
-    bool blink;
-
-    if (menuState == MENU_ROOT) {
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            timer = 0;
-            menuDisplay = MENU_SET_TIMER;
-            break;
-
-        case MENU_EVENT_RELEASE_BUTTON1:
-            if (timer < MENU_5_SEC_PASSED) {
-                menuState = MENU_SET_TIMER;
-            }
-
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            if (timer > MENU_3_SEC_PASSED) {
-                timer = 0;
-
-                if (getButton1() ) {
-                    setParamId (0);
-                    menuState = menuDisplay = MENU_SELECT_PARAM;
-                } else {
-                    if (getButton2() ) {    // Enable/Disable thermostat
-                        if (isRelayEnabled() && !isFTimer() ) {
-                            enableRelay (false);
-                        } else {
-                            enableRelay (true);
-                        }
-                    } else if (getButton3() ) { // Start/Stop fermentation timer
-                        if (isFTimer() ) {
-                            stopFTimer();
-                            enableRelay (false);
-                        } else {
-                            startFTimer();
-                            enableRelay (true);
-                        }
-                    }
-                }
-
-            }
-
-            break;
-
-        default:
-            if (timer > MENU_5_SEC_PASSED) {
-                timer = 0;
-                menuState = menuDisplay = MENU_ROOT;
-            }
-
-            break;
-        }
-    } else if (menuState == MENU_SELECT_PARAM) {
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            menuState = menuDisplay = MENU_CHANGE_PARAM;
+    const struct menuTransition* t = transitions[menuState][event];
 
-        case MENU_EVENT_RELEASE_BUTTON1:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON2:
-            incParamId();
+    if (t == 0) {
+        return;
+    }
 
-        case MENU_EVENT_RELEASE_BUTTON2:
-            timer = 0;
-            break;
+    while (t->guard != 0 && !t->guard() ) {
+        t++;
+    }
 
-        case MENU_EVENT_PUSH_BUTTON3:
-            decParamId();
+    if (t->action != 0) {
+        t->action();
+    }
 
-        case MENU_EVENT_RELEASE_BUTTON3:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            if (timer > MENU_1_SEC_PASSED + MENU_AUTOINC_DELAY) {
-                if (getButton2() ) {
-                    incParamId();
-                    timer = MENU_1_SEC_PASSED;
-                } else if (getButton3() ) {
-                    decParamId();
-                    timer = MENU_1_SEC_PASSED;
-                }
-            }
-
-            if (timer > MENU_5_SEC_PASSED) {
-                timer = 0;
-                setParamId (0);
-                storeParams();
-                menuState = menuDisplay = MENU_ROOT;
-            }
-
-            break;
-
-        default:
-            break;
-        }
-    } else if (menuState == MENU_CHANGE_PARAM) {
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            menuState = menuDisplay = MENU_SELECT_PARAM;
-
-        case MENU_EVENT_RELEASE_BUTTON1:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON2:
-            incParam();
-
-        case MENU_EVENT_RELEASE_BUTTON2:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON3:
-            decParam();
-
-        case MENU_EVENT_RELEASE_BUTTON3:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            if (timer > MENU_1_SEC_PASSED + MENU_AUTOINC_DELAY) {
-                if (getButton2() ) {
-                    incParam();
-                    timer = MENU_1_SEC_PASSED;
-                } else if (getButton3() ) {
-                    decParam();
-                    timer = MENU_1_SEC_PASSED;
-                }
-            }
-
-            if (getButton1() && timer > MENU_3_SEC_PASSED) {
-                timer = 0;
-                menuState = menuDisplay = MENU_SELECT_PARAM;
-                break;
-            }
-
-            if (timer > MENU_5_SEC_PASSED) {
-                timer = 0;
-                storeParams();
-                menuState = menuDisplay = MENU_ROOT;
-            }
-
-            break;
-
-        default:
-            break;
-        }
-    } else if (menuState == MENU_SET_TIMER) {
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            timer = 0;
-            menuDisplay = MENU_ROOT;
-            setDisplayOff (false);
-            break;
-
-        case MENU_EVENT_RELEASE_BUTTON1:
-            if (timer < MENU_5_SEC_PASSED) {
-                storeParams();
-                menuState = MENU_ROOT;
-                setDisplayOff (false);
-            }
-
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON2:
-            setParamId (PARAM_FERMENTATION_TIME);
-            incParam();
-
-        case MENU_EVENT_RELEASE_BUTTON2:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON3:
-            setParamId (PARAM_FERMENTATION_TIME);
-            decParam();
-
-        case MENU_EVENT_RELEASE_BUTTON3:
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            if (getButton2() || getButton3() ) {
-                blink = false;
-            } else {
-                blink = (bool) ( (unsigned char) getUptimeTicks() & 0x80);
-            }
-
-            if (timer > MENU_1_SEC_PASSED + MENU_AUTOINC_DELAY) {
-                setParamId (PARAM_FERMENTATION_TIME);
-
-                if (getButton2() ) {
-                    incParam();
-                    timer = MENU_1_SEC_PASSED;
-                } else if (getButton3() ) {
-                    decParam();
-                    timer = MENU_1_SEC_PASSED;
-                }
-            }
-
-            setDisplayOff (blink);
-
-            if (timer > MENU_5_SEC_PASSED) {
-                timer = 0;
-
-                if (getButton1() ) {
-                    menuState = menuDisplay = MENU_SELECT_PARAM;
-                    setDisplayOff (false);
-                    break;
-                }
-
-                storeParams();
-                menuState = menuDisplay = MENU_ROOT;
-                setDisplayOff (false);
-            }
-
-            break;
-
-        default:
-            break;
-        }
+    if (t->next != MENU_STATE_SAME) {
+        menuState = t->next;
     }
 }
 
 /**
  * @brief This function is being called during timer's interrupt
  *  request so keep it extremely small and fast.
- *  During this call all time-related functionality of application
- *  menu is handled. For example: fast value change while holding
- *  a button, return to root menu when no action is received from
- *  user within a given time.
+ *  The check of menu timer is queued here and all time-related
+ *  functionality of application menu is handled later in the main
+ *  loop. For example: fast value change while holding a button, return
+ *  to root menu when no action is received from user within a given
+ *  time.
  */
 void refreshMenu()
 {
-    timer++;
-    feedMenu (MENU_EVENT_CHECK_TIMER);
+    postEvent (MENU_EVENT_CHECK_TIMER);
+}
+
+/**
+ * @brief Feeds all queued events to the menu. This function is being
+ *  called from the main loop, so parameters could be stored into the
+ *  EEPROM without blocking interrupts.
+ */
+void processMenuEvents()
+{
+    struct event ev;
+
+    while (pollEvent (&ev) ) {
+        if (ev.id == MENU_EVENT_CHECK_TIMER) {
+            timer++;
+        } else if (ev.id <= MENU_EVENT_PUSH_BUTTON3) {
+            // Any button acknowledges the latched fault
+            clearRelayFault();
+            wakeDisplay();
+        }
+
+        feedMenu (ev.id);
+
+        // Values in the menu are changed by buttons and by holding them
+        if (ev.id != MENU_EVENT_CHECK_TIMER || menuState != MENU_STATE_ROOT) {
+            markUiDirty (UI_SOURCE_MENU);
+        }
+    }
+
+    // Keep the user interface responsive while the menu is in use.
+    if (menuState == MENU_STATE_ROOT) {
+        releaseFullSpeed (POWER_HOLD_MENU);
+    } else {
+        holdFullSpeed (POWER_HOLD_MENU);
+    }
 }
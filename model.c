@@ -0,0 +1,274 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * First-order-plus-dead-time model of the heater being learned online.
+ * The rate of heating is:
+ *  dT/dt = (Tamb + K - T) / tau
+ * and the rate of cooling is:
+ *  dT/dt = (Tamb - T) / tau
+ * where the heater acts after the lag L.
+ *
+ * Every heating run is observed:
+ *  - the lag is the time from switching the heater on until the
+ *    temperature rises by MODEL_RISE;
+ *  - tau is found from the decrease of the heating rate between the first
+ *    and the last minutes of the run, when the run is long enough;
+ *  - the gain is tau multiplied by the difference between the rates of
+ *    heating and cooling at the temperature the heater was cut off.
+ * The learned values are averaged with the stored ones and kept in the
+ * hidden parameters.
+ *
+ * After the heater is cut off, the temperature keeps rising during the
+ * lag, so the expected overshoot is reported to the relay module.
+ */
+
+#include "model.h"
+#include "adc.h"
+#include "params.h"
+#include "timer.h"
+
+// Rise in tenth of degrees of Celsius which ends the lag
+#define MODEL_RISE              3
+// Period of measurement of rate in seconds
+#define MODEL_RATE_PERIOD       60
+// The smallest rise within the heating run to learn tau
+#define MODEL_MIN_SPAN          50
+// The first one of learned parameters, they go in a row
+#define MODEL_FIRST_PARAM       PARAM_MODEL_GAIN
+#define MODEL_PARAMS_COUNT      3
+/* States of observation */
+#define MODEL_STATE_IDLE        0
+#define MODEL_STATE_LAG         1
+#define MODEL_STATE_HEATING     2
+#define MODEL_STATE_COOLING     3
+
+static unsigned char state;
+static unsigned long switchTime;
+static unsigned long sampleTime;
+static int sampleTemperature;
+static int startTemperature;
+/* Rates in tenth of degrees of Celsius per minute */
+static int rate;
+static int firstRate;
+static int firstTemperature;
+static int heatingRate;
+/* Temperature at the moment the heater was cut off */
+static int cutTemperature;
+/* Learned values being stored into EEPROM last time */
+static int storedParams[MODEL_PARAMS_COUNT];
+/* The smallest changes of learned values worth to be stored: gain in
+   tenth of degrees, tau in minutes and lag in seconds. */
+static const int storeThreshold[MODEL_PARAMS_COUNT] = {10, 2, 10};
+
+/**
+ * @brief Initialize the model observer.
+ */
+void initModel()
+{
+    unsigned char i;
+
+    state = MODEL_STATE_IDLE;
+    rate = firstRate = 0;
+
+    for (i = 0; i < MODEL_PARAMS_COUNT; i++) {
+        storedParams[i] = getParamById (MODEL_FIRST_PARAM + i);
+    }
+}
+
+/**
+ * @brief Averages the learned value with the stored one.
+ * @param id - identifier of the parameter.
+ * @param val - learned value.
+ * @param blend - false when the parameter was never learned before, so
+ *  the learned value is taken as is.
+ */
+static void learnParam (unsigned char id, long val, bool blend)
+{
+    if (val < getParamMin (id) ) {
+        val = getParamMin (id);
+    } else if (val > getParamMax (id) ) {
+        val = getParamMax (id);
+    }
+
+    if (blend) {
+        val = (getParamById (id) * 3L + val) >> 2;
+    }
+
+    setParamById (id, (int) val);
+}
+
+/**
+ * @brief Stores learned parameters into EEPROM when any of them is
+ *  changed noticeably since it was stored last time. The lag is blended
+ *  on every heating run, so storing every small change would wear
+ *  the EEPROM.
+ */
+static void storeModel()
+{
+    unsigned char i;
+    int diff;
+
+    for (i = 0; i < MODEL_PARAMS_COUNT; i++) {
+        diff = getParamById (MODEL_FIRST_PARAM + i) - storedParams[i];
+
+        if (diff >= storeThreshold[i] || diff <= -storeThreshold[i]) {
+            break;
+        }
+    }
+
+    if (i == MODEL_PARAMS_COUNT) {
+        return;
+    }
+
+    for (i = 0; i < MODEL_PARAMS_COUNT; i++) {
+        storedParams[i] = getParamById (MODEL_FIRST_PARAM + i);
+    }
+
+    storeParams();
+}
+
+/**
+ * @brief Measures the rate of temperature change once in MODEL_RATE_PERIOD.
+ * @param now - uptime in seconds.
+ * @return true when the new rate is measured.
+ */
+static bool measureRate (unsigned long now)
+{
+    int t = getTemperature();
+
+    if (now - sampleTime < MODEL_RATE_PERIOD) {
+        return false;
+    }
+
+    rate = t - sampleTemperature;
+    sampleTemperature = t;
+    sampleTime = now;
+    return true;
+}
+
+/**
+ * @brief Observes the temperature and the state of heater. This function
+ *  is being called from refreshRelay().
+ * @param heating - true while the heater is on.
+ */
+void refreshModel (bool heating)
+{
+    unsigned long now = getUptime();
+    bool learned = getParamById (PARAM_MODEL_GAIN) != 0;
+    int tau;
+
+    switch (state) {
+    case MODEL_STATE_IDLE:
+        if (heating) {
+            state = MODEL_STATE_LAG;
+            switchTime = now;
+            startTemperature = getTemperature();
+        }
+
+        break;
+
+    case MODEL_STATE_LAG:
+        if (!heating) {
+            state = MODEL_STATE_IDLE;
+        } else if (getTemperature() - startTemperature >= MODEL_RISE) {
+            state = MODEL_STATE_HEATING;
+            learnParam (PARAM_MODEL_LAG, now - switchTime,
+                        getParamById (PARAM_MODEL_LAG) != 0);
+            sampleTime = now;
+            sampleTemperature = getTemperature();
+            rate = firstRate = 0;
+        }
+
+        break;
+
+    case MODEL_STATE_HEATING:
+        if (measureRate (now) && firstRate == 0) {
+            firstRate = rate;
+            firstTemperature = sampleTemperature;
+        }
+
+        if (!heating) {
+            state = MODEL_STATE_COOLING;
+            heatingRate = rate;
+            cutTemperature = getTemperature();
+            switchTime = now;
+        }
+
+        break;
+
+    case MODEL_STATE_COOLING:
+        if (heating) {
+            state = MODEL_STATE_IDLE;
+            break;
+        }
+
+        // Wait until the heater does not act anymore
+        if (measureRate (now) && now - switchTime > getParamById (PARAM_MODEL_LAG)
+                && rate < 0) {
+            state = MODEL_STATE_IDLE;
+
+            if (cutTemperature - firstTemperature >= MODEL_MIN_SPAN
+                    && firstRate > heatingRate) {
+                tau = (cutTemperature - firstTemperature) / (firstRate - heatingRate);
+                learnParam (PARAM_MODEL_TAU, tau, learned);
+                learnParam (PARAM_MODEL_GAIN, (long) getParamById (PARAM_MODEL_TAU)
+                            * (heatingRate - rate), learned);
+            }
+
+            storeModel();
+        }
+
+        break;
+
+    default:
+        state = MODEL_STATE_IDLE;
+    }
+}
+
+/**
+ * @brief Calculates the rise of temperature expected after the heater is
+ *  cut off now. The heater keeps acting during the lag L, so the rise is
+ *  (Tamb + K - T) * (1 - exp (-L / tau)), which is approximated as
+ *  rate * tau * L / (tau + L).
+ * @return overshoot in tenth of degrees of Celsius.
+ */
+int getModelOvershoot()
+{
+    long tau = getParamById (PARAM_MODEL_TAU) * 60L;
+    long r = rate;
+
+    if (state != MODEL_STATE_HEATING || getParamById (PARAM_MODEL_LAG) == 0) {
+        return 0;
+    }
+
+    // Initial rate of the model until the rate is measured
+    if (firstRate == 0) {
+        if (getParamById (PARAM_MODEL_GAIN) == 0) {
+            return 0;
+        }
+
+        r = getParamById (PARAM_MODEL_GAIN) / getParamById (PARAM_MODEL_TAU);
+    }
+
+    if (r <= 0) {
+        return 0;
+    }
+
+    return (int) (r * getParamById (PARAM_MODEL_LAG) * getParamById (PARAM_MODEL_TAU)
+                  / (tau + getParamById (PARAM_MODEL_LAG) ) );
+}
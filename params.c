@@ -17,6 +17,21 @@
 
 /**
  * Control functions for EEPROM storage of persistent application parameters.
+ * Values are kept in RAM and written into EEPROM in the background: words
+ * are programmed one by one from the main loop, which only polls for the
+ * end of programming.
+ *
+ * Parameters are stored as a log of records following the stages of
+ * fermentation profile. Every save appends a record into the next slot
+ * round-robin, the newest record with correct checksum and layout is
+ * loaded at boot.
+ * |--Seq--|--Layout--|--Values--|--CRC--|
+ * 0       1          2          27      28
+ *  Seq - sequence number being incremented with every record.
+ *  Layout - EEPROM_LAYOUT of the firmware which wrote the record.
+ *  Values - offsets of values from their minimum, one byte per parameter
+ *           or two bytes (big-endian) when the range doesn't fit a byte.
+ *  CRC - CRC-8 of the preceding bytes.
  *
  * The list of aplication parameters with default values:
  * Name |Def| Description
@@ -30,7 +45,20 @@
  * P5 - | 0 | 0 ... 10 Relay switching delay in minutes
  * P6 - |Off| On/Off Indication of overheating
  * P7 - | 44| Threshold value in degrees of Celsius
+ * P8 - | 5 | 1 ... 7 Filter time constant at steady state (2^n samples)
  * FT - | 8h| 1h ... 15h Fermentation time in hours
+ * P10- | 1 | 0 ... 4 Filter time constant after a step (2^n samples)
+ * P11- | 0 | 0 ... 1 Control mode: 0 - hysteresis, 1 - PID
+ * P12- |100| 0 ... 250 PID proportional gain, 0.1% of duty per 0.1 C
+ * P13- | 10| 0 ... 100 PID integral gain, about 0.1% of duty per C per minute
+ * P14- | 0 | 0 ... 100 PID derivative gain, 0.1% of duty per 0.1 C per sample
+ * P15- | 20| 5 ... 120 Time-proportioning window in seconds
+ * P19- | 8 | 1 ... 8 Brightness of display
+ *
+ * Hidden parameters being learned by the heater model (16 ... 18):
+ *      | 0 | 0 ... 2000 Gain in tenth of degrees of Celsius
+ *      | 60| 1 ... 600 Time constant in minutes
+ *      | 0 | 0 ... 1800 Lag in seconds
  */
 
 #include "params.h"
@@ -39,32 +67,168 @@
 
 /* Definitions for EEPROM */
 #define EEPROM_BASE_ADDR        0x4000
-#define EEPROM_PARAMS_OFFSET    100
+#define EEPROM_SIZE             128
+// Records are kept after the stages of fermentation profile
+#define EEPROM_LOG_OFFSET       16
+// Records are written by words of 4 bytes
+#define EEPROM_WORD_SIZE        4
+#define EEPROM_RECORD_SIZE      28
+#define EEPROM_RECORDS          ( (EEPROM_SIZE - EEPROM_LOG_OFFSET) / EEPROM_RECORD_SIZE)
+#define EEPROM_RECORD_ADDR(N)   ( (const unsigned char*) (EEPROM_BASE_ADDR + EEPROM_LOG_OFFSET \
+                                  + (N) * EEPROM_RECORD_SIZE) )
+// Offsets of sequence number, layout and checksum within the record
+#define EEPROM_RECORD_SEQ       0
+#define EEPROM_RECORD_LAYOUT    1
+#define EEPROM_RECORD_VALUES    2
+#define EEPROM_RECORD_CRC       (EEPROM_RECORD_SIZE - 1)
+// Version of packing, to be changed along with the list of parameters
+// or their ranges
+#define EEPROM_LAYOUT           1
+// CRC-8 with polynomial x^8 + x^5 + x^4 + 1
+#define EEPROM_CRC_INIT         0xFF
+#define EEPROM_CRC_POLY         0x31
+
+#if EEPROM_RECORD_SIZE % EEPROM_WORD_SIZE != 0
+#error "Records should fill words of EEPROM entirely"
+#endif
 
 static unsigned char paramId;
-static int paramCache[10];
-const int paramMin[] = {0, 1, 30, 10, -70, 0, 0, 300, 0, 1};
-const int paramMax[] = {1, 150, 70, 45, 70, 10, 1, 550, 0, 15};
-const int paramDefault[] = {0, 20, 50, 20, 0, 0, 0, 440, 0, 8};
+static int paramCache[PARAM_COUNT];
+const int paramMin[] = {0, 1, 30, 10, -70, 0, 0, 300, 1, 1, 0, 0, 0, 0, 0, 5, 0, 1, 0, 1};
+const int paramMax[] = {1, 150, 70, 45, 70, 10, 1, 550, 7, 15, 4, 1, 250, 100, 100, 120,
+                        2000, 600, 1800, 8
+                       };
+const int paramDefault[] = {0, 20, 50, 20, 0, 0, 0, 440, 5, 8, 1, 0, 100, 10, 0, 20, 0, 60, 0, 8};
+
+/* The record being written into EEPROM. */
+static unsigned char record[EEPROM_RECORD_SIZE];
+/* Slot and sequence number of the newest record. */
+static unsigned char recordSlot;
+static unsigned char recordSeq;
+/* The newest record is valid. */
+static bool recordValid;
+/* Offset of the next word of record to be written, EEPROM_RECORD_SIZE
+   when no record is being written. */
+static unsigned char writeOffset;
+/* The word is being programmed. */
+static bool writing;
+/* Parameters were changed while the record was being written. */
+static bool storeAgain;
 
 /**
- * @brief Check values in the EEPROM to be correct then load them into
- * parameters' cache.
+ * @brief Calculates CRC-8 checksum of the data.
+ * @param data
+ * @param len - length of data in bytes.
+ * @return checksum.
+ */
+static unsigned char crc8 (const unsigned char* data, unsigned char len)
+{
+    unsigned char i, crc = EEPROM_CRC_INIT;
+
+    while (len-- > 0) {
+        crc ^= *data++;
+
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ EEPROM_CRC_POLY : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Checks whether the range of parameter values doesn't fit into
+ *  one byte.
+ * @param id
+ * @return true if the value is packed into two bytes.
+ */
+static bool isParamWide (unsigned char id)
+{
+    return paramMax[id] - paramMin[id] > 0xFF;
+}
+
+/**
+ * @brief Packs values of parameters into the record as offsets from
+ *  their minimal values, one or two bytes per parameter. All parameters
+ *  take 23 bytes, so they fit between the layout and checksum.
+ */
+static void packRecord()
+{
+    unsigned char i, n = EEPROM_RECORD_VALUES;
+    unsigned int val;
+
+    for (i = 0; i < PARAM_COUNT; i++) {
+        val = paramCache[i] - paramMin[i];
+
+        if (isParamWide (i) ) {
+            record[n++] = (unsigned char) (val >> 8);
+        }
+
+        record[n++] = (unsigned char) val;
+    }
+
+    while (n < EEPROM_RECORD_CRC) {
+        record[n++] = 0;
+    }
+}
+
+/**
+ * @brief Check records in the EEPROM to be correct then load values
+ *  from the newest one into parameters' cache.
  */
 void initParamsEEPROM()
 {
-    if (getButton2() && getButton3() ) {
+    unsigned char i, n;
+    const unsigned char* src;
+    unsigned int val;
+
+    writeOffset = EEPROM_RECORD_SIZE;
+    writing = storeAgain = false;
+    recordValid = false;
+    recordSlot = EEPROM_RECORDS - 1;
+    recordSeq = 0xFF;
+
+    // Look for the newest record with correct checksum and layout
+    for (i = 0; i < EEPROM_RECORDS; i++) {
+        src = EEPROM_RECORD_ADDR (i);
+
+        if (crc8 (src, EEPROM_RECORD_CRC) != src[EEPROM_RECORD_CRC]
+                || src[EEPROM_RECORD_LAYOUT] != EEPROM_LAYOUT) {
+            continue;
+        }
+
+        if (!recordValid || (signed char) (src[EEPROM_RECORD_SEQ] - recordSeq) > 0) {
+            recordValid = true;
+            recordSlot = i;
+            recordSeq = src[EEPROM_RECORD_SEQ];
+        }
+    }
+
+    if (!recordValid || (getButton2() && getButton3() ) ) {
         // Restore parameters to default values
-        for (paramId = 0; paramId < 10; paramId++) {
-            paramCache[paramId] = paramDefault[paramId];
+        for (i = 0; i < PARAM_COUNT; i++) {
+            paramCache[i] = paramDefault[i];
         }
 
         storeParams();
     } else {
-        // Load parameters from EEPROM
-        for (paramId = 0; paramId < 10; paramId++) {
-            paramCache[paramId] = * (int*) (EEPROM_BASE_ADDR + EEPROM_PARAMS_OFFSET
-                                            + (paramId * sizeof paramCache[0]) );
+        // Load parameters from the record
+        src = EEPROM_RECORD_ADDR (recordSlot);
+        n = EEPROM_RECORD_VALUES;
+
+        for (i = 0; i < PARAM_COUNT; i++) {
+            val = src[n++];
+
+            if (isParamWide (i) ) {
+                val = (val << 8) | src[n++];
+            }
+
+            // Keep the value in range even if the layout is not bumped
+            if (val > (unsigned int) (paramMax[i] - paramMin[i]) ) {
+                paramCache[i] = paramDefault[i];
+            } else {
+                paramCache[i] = paramMin[i] + val;
+            }
         }
     }
 
@@ -78,13 +242,33 @@ void initParamsEEPROM()
  */
 int getParamById (unsigned char id)
 {
-    if (id < 10) {
+    if (id < PARAM_COUNT) {
         return paramCache[id];
     }
 
     return -1;
 }
 
+/**
+ * @brief Gets the lowest allowed value of the parameter.
+ * @param id
+ * @return minimum value.
+ */
+int getParamMin (unsigned char id)
+{
+    return paramMin[id];
+}
+
+/**
+ * @brief Gets the highest allowed value of the parameter.
+ * @param id
+ * @return maximum value.
+ */
+int getParamMax (unsigned char id)
+{
+    return paramMax[id];
+}
+
 /**
  * @brief
  * @param id
@@ -92,7 +276,7 @@ int getParamById (unsigned char id)
  */
 void setParamById (unsigned char id, int val)
 {
-    if (id < 10) {
+    if (id < PARAM_COUNT) {
         paramCache[id] = val;
     }
 }
@@ -116,15 +300,39 @@ void setParam (int val)
 }
 
 /**
- * @brief Incrementing the value of the currently selected parameter.
+ * @brief Changes the value of the currently selected parameter by the
+ *  given step. The value is clamped to the range of the parameter,
+ *  boolean parameters are toggled.
+ * @param step
+ *  signed step to be added to the value.
  */
-void incParam()
+void stepParam (int step)
 {
-    if (paramId == PARAM_RELAY_MODE || paramId == PARAM_OVERHEAT_INDICATION) {
+    int val;
+
+    if (paramId == PARAM_RELAY_MODE || paramId == PARAM_OVERHEAT_INDICATION
+            || paramId == PARAM_CONTROL_MODE) {
         paramCache[paramId] = ~paramCache[paramId] & 0x0001;
-    } else if (paramCache[paramId] < paramMax[paramId]) {
-        paramCache[paramId]++;
+        return;
+    }
+
+    val = paramCache[paramId] + step;
+
+    if (val > paramMax[paramId]) {
+        val = paramMax[paramId];
+    } else if (val < paramMin[paramId]) {
+        val = paramMin[paramId];
     }
+
+    paramCache[paramId] = val;
+}
+
+/**
+ * @brief Incrementing the value of the currently selected parameter.
+ */
+void incParam()
+{
+    stepParam (1);
 }
 
 /**
@@ -132,11 +340,7 @@ void incParam()
  */
 void decParam()
 {
-    if (paramId == PARAM_RELAY_MODE || paramId == PARAM_OVERHEAT_INDICATION) {
-        paramCache[paramId] = ~paramCache[paramId] & 0x0001;
-    } else if (paramCache[paramId] > paramMin[paramId]) {
-        paramCache[paramId]--;
-    }
+    stepParam (-1);
 }
 
 /**
@@ -154,33 +358,50 @@ unsigned char getParamId()
  */
 void setParamId (unsigned char val)
 {
-    if (val < 10) {
+    if (val < PARAM_COUNT) {
         paramId = val;
     }
 }
 
 /**
- * @brief
+ * @brief Checks whether the parameter is not available in the menu.
+ *  The fermentation time has its own menu and parameters of the model
+ *  are being learned.
+ * @param id
+ * @return true when hidden.
+ */
+static bool isParamHidden (unsigned char id)
+{
+    return id == PARAM_FERMENTATION_TIME
+           || (id >= PARAM_MODEL_GAIN && id <= PARAM_MODEL_LAG);
+}
+
+/**
+ * @brief Selects the next parameter available in the menu.
  */
 void incParamId()
 {
-    if (paramId < 7) {
-        paramId++;
-    } else {
-        paramId = 0;
-    }
+    do {
+        if (paramId < PARAM_COUNT - 1) {
+            paramId++;
+        } else {
+            paramId = 0;
+        }
+    } while (isParamHidden (paramId) );
 }
 
 /**
- * @brief
+ * @brief Selects the previous parameter available in the menu.
  */
 void decParamId()
 {
-    if (paramId > 0) {
-        paramId--;
-    } else {
-        paramId = 7;
-    }
+    do {
+        if (paramId > 0) {
+            paramId--;
+        } else {
+            paramId = PARAM_COUNT - 1;
+        }
+    } while (isParamHidden (paramId) );
 }
 
 /**
@@ -243,10 +464,42 @@ void paramToString (unsigned char id, unsigned char* strBuff)
         itofpa (paramCache[id], strBuff, 0);
         break;
 
+    case PARAM_FILTER_SLOW:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
     case PARAM_FERMENTATION_TIME:
         itofpa (paramCache[id], strBuff, 6);
         break;
 
+    case PARAM_FILTER_FAST:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
+    case PARAM_CONTROL_MODE:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
+    case PARAM_PID_KP:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
+    case PARAM_PID_KI:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
+    case PARAM_PID_KD:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
+    case PARAM_PID_WINDOW:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
+    case PARAM_BRIGHTNESS:
+        itofpa (paramCache[id], strBuff, 6);
+        break;
+
     default: // Display "OFF" to all unknown ID
         ( (unsigned char*) strBuff) [0] = 'O';
         ( (unsigned char*) strBuff) [1] = 'F';
@@ -256,48 +509,95 @@ void paramToString (unsigned char id, unsigned char* strBuff)
 }
 
 /**
- * @brief Stores updated parameters from paramCache into EEPROM.
+ * @brief Queues updated parameters from paramCache to be stored into
+ *  EEPROM. The new record is written into the slot next to the newest
+ *  one by refreshParams(), so writes are spread over the EEPROM.
  */
 void storeParams()
 {
     unsigned char i;
+    const unsigned char* src;
 
-    //  Check if the EEPROM is write-protected.  If it is then unlock the EEPROM.
-    if ( (FLASH_IAPSR & 0x08) == 0) {
-        FLASH_DUKR = 0xAE;
-        FLASH_DUKR = 0x56;
+    if (writeOffset < EEPROM_RECORD_SIZE || writing) {
+        storeAgain = true;
+        return;
     }
 
-    //  Write to the EEPROM parameters which value is changed.
-    for (i = 0; i < 10; i++) {
-        if (paramCache[i] != (* (int*) (EEPROM_BASE_ADDR + EEPROM_PARAMS_OFFSET
-                                        + (i * sizeof paramCache[0]) ) ) ) {
-            * (int*) (EEPROM_BASE_ADDR + EEPROM_PARAMS_OFFSET
-                      + (i * sizeof paramCache[0]) ) = paramCache[i];
+    packRecord();
+
+    // Skip the record when nothing is changed
+    if (recordValid) {
+        src = EEPROM_RECORD_ADDR (recordSlot);
+
+        for (i = EEPROM_RECORD_VALUES; i < EEPROM_RECORD_CRC && record[i] == src[i]; i++);
+
+        if (i == EEPROM_RECORD_CRC) {
+            return;
         }
     }
 
-    //  Now write protect the EEPROM.
-    FLASH_IAPSR &= ~0x08;
+    recordSlot = (recordSlot + 1) % EEPROM_RECORDS;
+    recordSeq++;
+    recordValid = false;
+    record[EEPROM_RECORD_SEQ] = recordSeq;
+    record[EEPROM_RECORD_LAYOUT] = EEPROM_LAYOUT;
+    record[EEPROM_RECORD_CRC] = crc8 (record, EEPROM_RECORD_CRC);
+    writeOffset = 0;
 }
+
 /**
- * @brief
- * @param val
- * @param offset
+ * @brief Writes the queued record into EEPROM one word at a time. This
+ *  function is being called from the main loop. It returns immediately
+ *  while the word is being programmed, so values of parameters are read
+ *  from paramCache meanwhile. When the power is lost in the middle of
+ *  the record its checksum is wrong and the previous one is loaded.
  */
-static void writeEEPROM (unsigned char val, unsigned char offset)
+void refreshParams()
 {
+    unsigned char i;
+    unsigned char* dst;
+
+    if (writing) {
+        // Reading of the status clears the end of programming flag
+        if ( (FLASH_IAPSR & 0x04) == 0) {
+            return;
+        }
+
+        writing = false;
+
+        if (writeOffset == EEPROM_RECORD_SIZE) {
+            //  Now write protect the EEPROM.
+            FLASH_IAPSR &= ~0x08;
+            recordValid = true;
+
+            if (storeAgain) {
+                storeAgain = false;
+                storeParams();
+            }
+        }
+    }
+
+    if (writeOffset == EEPROM_RECORD_SIZE) {
+        return;
+    }
+
     //  Check if the EEPROM is write-protected.  If it is then unlock the EEPROM.
     if ( (FLASH_IAPSR & 0x08) == 0) {
         FLASH_DUKR = 0xAE;
         FLASH_DUKR = 0x56;
     }
 
-    //  Write the data to the EEPROM.
-    (* (unsigned char*) (EEPROM_BASE_ADDR + offset) ) = val;
+    //  Program the whole word at once (WPRG)
+    FLASH_CR2 = 0x40;
+    FLASH_NCR2 = 0xBF;
+    dst = (unsigned char*) EEPROM_RECORD_ADDR (recordSlot) + writeOffset;
+
+    for (i = 0; i < EEPROM_WORD_SIZE; i++) {
+        dst[i] = record[writeOffset + i];
+    }
 
-    //  Now write protect the EEPROM.
-    FLASH_IAPSR &= ~0x08;
+    writeOffset += EEPROM_WORD_SIZE;
+    writing = true;
 }
 
 /**
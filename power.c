@@ -0,0 +1,106 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Power management.
+ * While no module holds a request for full speed, the CPU clock is
+ * divided but the master clock of peripherals is kept at 16 MHz, so
+ * the display multiplexing and the ADC timing are not affected.
+ * The divider only slows down the main loop: the timer's interrupt,
+ * which runs tasks of every tick, switches the CPU to full speed for its
+ * duration, so the handlers keep the budget of a tick at 16 MHz. The CPU
+ * clock is stopped while waiting for an interrupt anyway.
+ * Once the display is asleep, nothing depends on the rate of timer's
+ * interrupt, so the master clock is divided too. The timer interrupts
+ * four times less often then and every interrupt stands for four ticks,
+ * which keeps the uptime and the periods of tasks.
+ */
+
+#include "power.h"
+#include "stm8s003/clock.h"
+#include "display.h"
+#include "timer.h"
+
+#define INTERRUPT_ENABLE    __asm rim __endasm;
+#define INTERRUPT_DISABLE   __asm sim __endasm;
+#define WAIT_FOR_INTERRUPT  __asm wfi __endasm;
+
+// fMASTER = 16 MHz, fCPU = 4 MHz
+#define POWER_CLK_IDLE          0x02
+// fMASTER = 4 MHz, fCPU = 1 MHz
+#define POWER_CLK_SLOW          0x12
+// Ticks per timer's interrupt at fMASTER = 4 MHz
+#define POWER_SLOW_TICK_WEIGHT  4
+
+static unsigned char holds;
+
+/**
+ * @brief Initialize the power manager with the full speed of CPU.
+ */
+void initPower()
+{
+    holds = 0;
+    CLK_CKDIVR = POWER_CLK_FULL;
+}
+
+/**
+ * @brief Requests the full speed of CPU until it is released.
+ * @param id
+ *  Identifier of the module making this request.
+ */
+void holdFullSpeed (unsigned char id)
+{
+    holds |= id;
+}
+
+/**
+ * @brief Releases the request for full speed of CPU.
+ * @param id
+ *  Identifier of the module which made the request.
+ */
+void releaseFullSpeed (unsigned char id)
+{
+    holds &= ~id;
+}
+
+/**
+ * @brief Selects the clock configuration appropriate to current
+ *  requests and waits for the next interrupt. This function is being
+ *  called from the main loop when there is nothing to do.
+ */
+void enterIdle()
+{
+    unsigned char clk;
+
+    if (holds != 0) {
+        clk = POWER_CLK_FULL;
+    } else if (isDisplayAsleep() ) {
+        clk = POWER_CLK_SLOW;
+    } else {
+        clk = POWER_CLK_IDLE;
+    }
+
+    if (clk != CLK_CKDIVR) {
+        // The weight and the rate of interrupts are changed together
+        INTERRUPT_DISABLE
+        CLK_CKDIVR = clk;
+        setTickWeight (clk == POWER_CLK_SLOW ? POWER_SLOW_TICK_WEIGHT : 1);
+        INTERRUPT_ENABLE
+    }
+
+    WAIT_FOR_INTERRUPT
+}
@@ -0,0 +1,263 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Fermentation profile engine.
+ * The fermentation is a sequence of stages. During every stage the
+ * setpoint is ramped from its current value to the target temperature
+ * at the given rate, then it is held for the given number of hours.
+ *
+ * Stages are stored in the EEPROM, 4 bytes per stage:
+ * |--Target--|--Rate--|--Hold--|
+ * 0          2        3        4
+ *  Target - temperature in tenth of degrees of Celsius (int).
+ *  Rate - ramp rate in tenth of degrees of Celsius per hour, zero value
+ *         means an immediate change of setpoint.
+ *  Hold - hold time in hours.
+ * A stage with zero rate and zero hold time ends the sequence. When the
+ * first stage is empty, a single stage at the threshold parameter is
+ * held during the fermentation time parameter.
+ * Stages are written into the EEPROM along with the firmware, the image
+ * is made by "make eeprom ProfileStages=..." (see tools/eeprom_profile.py).
+ * The profile is advanced by seconds of uptime being passed since the
+ * previous call, so a late call of refreshProfile() doesn't delay it.
+ */
+
+#include "profile.h"
+#include "params.h"
+#include "adc.h"
+#include "relay.h"
+#include "timer.h"
+
+#define PROFILE_EEPROM_ADDR     0x4000
+#define PROFILE_STAGES_MAX      4
+#define PROFILE_SECONDS_IN_HOUR 3600
+#define BITS_FOR_MINUTES        6
+#define BITMASK(L)              ( ~ (0xFFFFFFFF << (L) ) )
+
+struct profileStage {
+    int target;
+    unsigned char rate;
+    unsigned char hold;
+};
+
+static const struct profileStage* stages = (const struct profileStage*) PROFILE_EEPROM_ADDR;
+
+static bool running;
+static bool legacy;
+static unsigned char stage;
+static unsigned char rate;
+static int setpoint;
+static int target;
+static unsigned int rampAcc;
+/**
+ * Hold timer of current stage.
+ * |--Hour--|--Minute--|
+ * 11       6          0
+ */
+static unsigned int fTimer;
+static unsigned char fTimerSeconds;
+/* Uptime when the profile was advanced last time. */
+static unsigned long lastUptime;
+
+/**
+ * @brief Initialize the profile engine in stopped state.
+ */
+void initProfile()
+{
+    running = false;
+    fTimer = 0;
+}
+
+/**
+ * @brief Prepares given stage of the profile to be run.
+ * @param id
+ *  Index of the stage.
+ * @return false if there is no such stage.
+ */
+static bool loadStage (unsigned char id)
+{
+    unsigned char hold;
+
+    legacy = id == 0 && stages[0].rate == 0 && stages[0].hold == 0;
+
+    if (legacy) {
+        target = getParamById (PARAM_THRESHOLD);
+        rate = 0;
+        hold = getParamById (PARAM_FERMENTATION_TIME);
+    } else if (id < PROFILE_STAGES_MAX && (stages[id].rate != 0 || stages[id].hold != 0) ) {
+        target = stages[id].target;
+        rate = stages[id].rate;
+        hold = stages[id].hold;
+    } else {
+        return false;
+    }
+
+    if (rate == 0) {
+        setpoint = target;
+    }
+
+    if (hold > 0) {
+        fTimer = ( (hold - 1) << BITS_FOR_MINUTES) + 59;
+    } else {
+        fTimer = 0;
+    }
+
+    fTimerSeconds = 59;
+    rampAcc = 0;
+    stage = id;
+    return true;
+}
+
+/**
+ * @brief Starts fermentation from the first stage of the profile.
+ *  The setpoint is ramped starting from current temperature.
+ */
+void startFTimer()
+{
+    setpoint = getTemperature();
+    lastUptime = getUptime();
+    running = loadStage (0);
+}
+
+/**
+ * @brief Stops fermentation.
+ */
+void stopFTimer()
+{
+    running = false;
+    fTimer = 0;
+}
+
+/**
+ * @brief Checks fermentation to be active.
+ * @return True if fermentation is active.
+ */
+bool isFTimer()
+{
+    return running;
+}
+
+/**
+ * @brief Gets minutes part of the hold timer of current stage.
+ * @return number of minutes remaining until end of that hour.
+ */
+unsigned char getFTimerMinutes()
+{
+    return (unsigned char) (fTimer & BITMASK (BITS_FOR_MINUTES) );
+}
+
+/**
+ * @brief Gets hours part of the hold timer of current stage.
+ * @return number of hours remaining.
+ */
+unsigned char getFTimerHours()
+{
+    return (unsigned char) (fTimer >> BITS_FOR_MINUTES);
+}
+
+/**
+ * @brief Gets index of the stage being run.
+ * @return index of the stage.
+ */
+unsigned char getProfileStage()
+{
+    return stage;
+}
+
+/**
+ * @brief Gets the temperature to be maintained by the relay.
+ * @return setpoint of the profile when fermentation is active, value
+ *  of the threshold parameter otherwise.
+ */
+int getSetpoint()
+{
+    if (running && !legacy) {
+        return setpoint;
+    }
+
+    return getParamById (PARAM_THRESHOLD);
+}
+
+/**
+ * @brief Advances the profile by one second. Only a constant amount
+ *  of work is done on every call: one step of the ramp or one step of
+ *  the hold timer.
+ */
+static void stepProfile()
+{
+    if (legacy) {
+        setpoint = target = getParamById (PARAM_THRESHOLD);
+    }
+
+    // Ramp the setpoint before holding.
+    if (setpoint != target) {
+        rampAcc += rate;
+
+        if (rampAcc >= PROFILE_SECONDS_IN_HOUR) {
+            rampAcc -= PROFILE_SECONDS_IN_HOUR;
+
+            if (setpoint < target) {
+                setpoint++;
+            } else {
+                setpoint--;
+            }
+        }
+
+        return;
+    }
+
+    if (fTimer == 0) {
+        // Disable the relay functionality when the last stage is finished.
+        if (!loadStage (stage + 1) ) {
+            running = false;
+            enableRelay (false);
+        }
+
+        return;
+    }
+
+    if (fTimerSeconds > 0) {
+        fTimerSeconds--;
+        return;
+    }
+
+    fTimerSeconds = 59;
+
+    if (getFTimerMinutes() > 0) {
+        fTimer--;
+    } else {
+        fTimer = ( (getFTimerHours() - 1) << BITS_FOR_MINUTES) + 59;
+    }
+}
+
+/**
+ * @brief Advances the profile by every second of uptime being passed
+ *  since the previous call. This function is being called from the main
+ *  loop once a second.
+ */
+void refreshProfile()
+{
+    unsigned long now = getUptime();
+
+    while (running && lastUptime != now) {
+        lastUptime++;
+        stepProfile();
+    }
+
+    lastUptime = now;
+}
@@ -17,25 +17,48 @@
 
 /**
  * Control functions for relay.
+ * The relay is controlled either by the thermostat with hysteresis or by
+ * the PID controller, depending on PARAM_CONTROL_MODE. The output of the
+ * PID controller is the duty cycle being applied over the time-proportioning
+ * window of PARAM_PID_WINDOW seconds by tickRelay().
+ * In heating mode the thermostat cuts the heater off in advance by the
+ * overshoot expected from the learned model of the heater.
  */
 
 #include "relay.h"
 #include "stm8s003/gpio.h"
 #include "adc.h"
-#include "timer.h"
+#include "alarm.h"
+#include "autotune.h"
+#include "model.h"
 #include "params.h"
+#include "profile.h"
+#include "ui.h"
 
 #define RELAY_PORT              PA_ODR
 #define RELAY_BIT               0x08
 #define RELAY_TIMER_MULTIPLIER  7
-#define RELAY_BUZZ_OFF_PULSES   6000
-#define RELAY_PRE_BUZZ_PULSES   10
-#define RELAY_BUZZ_ON_PULSES    60
+// Duty cycle of PID output in 0.1%
+#define RELAY_PID_OUTPUT_MAX    1000
+// Fraction bits of the integral term
+#define RELAY_PID_INTEGRAL_BITS 5
+// Limit of error in 0.1 C to keep the products within 16 bits
+#define RELAY_PID_ERROR_LIMIT   60
+// Minimal on/off time of relay in 0.1 s (ticks of tickRelay)
+#define RELAY_MIN_SWITCH_TIME   20
 
 static unsigned int timer;
-static unsigned int pulses;
 static bool state;
 static bool relayEnable;
+static unsigned char fault;
+/* State of PID controller */
+static int integral;
+static int lastError;
+/* Position within the time-proportioning window and time of relay
+   being on in the current and the next window, in 0.1 s. */
+static unsigned int windowTime;
+static unsigned int onTime;
+static unsigned int nextOnTime;
 
 /**
  * @brief Configure appropriate bits for GPIO port A, reset local timer
@@ -48,13 +71,16 @@ void initRelay()
     timer = 0;
     state = false;
     relayEnable = true;
+    fault = RELAY_FAULT_NONE;
+    integral = lastError = 0;
+    windowTime = onTime = nextOnTime = 0;
 }
 
 /**
  * @brief Sets state of the relay.
  * @param on - true, off - false
  */
-static void setRelay (bool on)
+void setRelay (bool on)
 {
     if (on) {
         RELAY_PORT |= RELAY_BIT;
@@ -67,34 +93,27 @@ static void setRelay (bool on)
 /**
  * @brief Changes state of the relay.
  */
-static void switchRelay ()
+void switchRelay ()
 {
     RELAY_PORT ^= RELAY_BIT;
 }
 
 /**
- * @brief Makes periodic buzz using relay when called on every tick.
+ * @brief Plays the alarm appropriate to the state of relay and updates
+ *  the user interface. The relay is kept in its safe state while a fault
+ *  is latched, so the fault is only shown on the display.
  */
-void buzzRelay ()
+static void updateAlarm()
 {
-    if (!isRelayEnabled() ) {
-        pulses++;
+    markUiDirty (UI_SOURCE_CONTROL);
 
-        if (pulses > (RELAY_BUZZ_OFF_PULSES + RELAY_PRE_BUZZ_PULSES + RELAY_BUZZ_ON_PULSES) ) {
-            pulses = 0;
-            setRelay (getParamById (PARAM_RELAY_MODE) );
-            return;
-        }
-
-        if (pulses > (RELAY_BUZZ_OFF_PULSES + RELAY_PRE_BUZZ_PULSES) ) {
-            switchRelay();
-            return;
-        }
-
-        // Ensure that relay is off before buzzing.
-        if (pulses > RELAY_BUZZ_OFF_PULSES) {
-            setRelay (false);
-        }
+    if (fault != RELAY_FAULT_NONE) {
+        stopAlarm();
+        setRelay (getParamById (PARAM_RELAY_MODE) );
+    } else if (!relayEnable) {
+        startAlarm (ALARM_END);
+    } else {
+        stopAlarm();
     }
 }
 
@@ -105,6 +124,7 @@ void buzzRelay ()
 void enableRelay (bool state)
 {
     relayEnable = state;
+    updateAlarm();
 }
 
 /**
@@ -117,20 +137,180 @@ bool isRelayEnabled()
 }
 
 /**
- * @brief This function is being called during timer's interrupt
- *  request so keep it extremely small and fast.
+ * @brief Forces the relay into its safe state and latches the fault code.
+ *  This function is being called from ADC's interrupt handler, so the
+ *  relay is switched off regardless of the scheduler. Only the first
+ *  fault is latched until it is cleared.
+ * @param code - one of RELAY_FAULT_* codes.
+ */
+void tripRelay (unsigned char code)
+{
+    setRelay (getParamById (PARAM_RELAY_MODE) );
+
+    if (fault == RELAY_FAULT_NONE) {
+        fault = code;
+        updateAlarm();
+    }
+}
+
+/**
+ * @brief Gets the latched fault code.
+ * @return RELAY_FAULT_NONE when no fault is latched.
+ */
+unsigned char getRelayFault()
+{
+    return fault;
+}
+
+/**
+ * @brief Clears the latched fault, so the relay can be switched on
+ *  again. The fault is latched again by the next trip of the analog
+ *  watchdog if the cause is not eliminated.
+ */
+void clearRelayFault()
+{
+    if (fault != RELAY_FAULT_NONE) {
+        fault = RELAY_FAULT_NONE;
+        updateAlarm();
+    }
+}
+
+/**
+ * @brief Calculates the duty cycle for the next time-proportioning window.
+ *  The integral term is clamped within the range of output and is not
+ *  integrated further while the output is saturated (anti-windup).
+ * @param error - deviation from setpoint in 0.1 C, positive when
+ *  the relay should be on.
+ * @return duty cycle in 0.1%.
+ */
+static int updatePID (int error)
+{
+    int output, step;
+
+    if (error > RELAY_PID_ERROR_LIMIT) {
+        error = RELAY_PID_ERROR_LIMIT;
+    } else if (error < -RELAY_PID_ERROR_LIMIT) {
+        error = -RELAY_PID_ERROR_LIMIT;
+    }
+
+    output = getParamById (PARAM_PID_KP) * error
+             + getParamById (PARAM_PID_KD) * (error - lastError);
+    lastError = error;
+    step = getParamById (PARAM_PID_KI) * error >> RELAY_PID_INTEGRAL_BITS;
+
+    // Conditional integration
+    if ( (step > 0 && output + (integral >> RELAY_PID_INTEGRAL_BITS) < RELAY_PID_OUTPUT_MAX)
+            || (step < 0 && output + (integral >> RELAY_PID_INTEGRAL_BITS) > 0) ) {
+        integral += step;
+    }
+
+    if (integral < 0) {
+        integral = 0;
+    } else if (integral > (RELAY_PID_OUTPUT_MAX << RELAY_PID_INTEGRAL_BITS) ) {
+        integral = RELAY_PID_OUTPUT_MAX << RELAY_PID_INTEGRAL_BITS;
+    }
+
+    output += integral >> RELAY_PID_INTEGRAL_BITS;
+
+    if (output < 0) {
+        output = 0;
+    } else if (output > RELAY_PID_OUTPUT_MAX) {
+        output = RELAY_PID_OUTPUT_MAX;
+    }
+
+    return output;
+}
+
+/**
+ * @brief Converts the duty cycle into the time of relay being on within
+ *  the window. Pulses shorter than RELAY_MIN_SWITCH_TIME are dropped,
+ *  so the relay is not switched too frequently.
+ * @param duty - duty cycle in 0.1%.
+ * @return time in 0.1 s.
+ */
+static unsigned int dutyToOnTime (int duty)
+{
+    unsigned int window = getParamById (PARAM_PID_WINDOW) * 10;
+    unsigned int time = (unsigned int) ( (unsigned long) window * duty / RELAY_PID_OUTPUT_MAX);
+
+    if (time < RELAY_MIN_SWITCH_TIME) {
+        return 0;
+    }
+
+    if (window - time < RELAY_MIN_SWITCH_TIME) {
+        return window;
+    }
+
+    return time;
+}
+
+/**
+ * @brief Switches the relay within the time-proportioning window while
+ *  the PID mode is active. This function is being called during timer's
+ *  interrupt request every 0.1 s so keep it extremely small and fast.
+ */
+void tickRelay()
+{
+    if (!isRelayEnabled() || fault != RELAY_FAULT_NONE
+            || !getParamById (PARAM_CONTROL_MODE) || isAutotune() ) {
+        return;
+    }
+
+    windowTime++;
+
+    if (windowTime >= getParamById (PARAM_PID_WINDOW) * 10) {
+        windowTime = 0;
+        onTime = nextOnTime;
+    }
+
+    setRelay (windowTime < onTime);
+}
+
+/**
+ * @brief Controls the relay by the latest temperature. This function is
+ *  being called from the main loop after every measurement, so it may
+ *  take longer than a tick.
  */
 void refreshRelay()
 {
     bool mode = getParamById (PARAM_RELAY_MODE);
+    int error, predicted;
 
-    if (!isRelayEnabled() ) {
+    // The model is being learned in heating mode only
+    refreshModel (!mode && (RELAY_PORT & RELAY_BIT) );
+
+    if (!isRelayEnabled() || fault != RELAY_FAULT_NONE) {
+        integral = lastError = 0;
+        nextOnTime = onTime = 0;
         setRelay (mode);
         return;
     }
 
+    if (isAutotune() ) {
+        error = getParamById (PARAM_THRESHOLD) - getTemperature();
+
+        if (mode) {
+            error = -error;
+        }
+
+        setRelay (refreshAutotune (error) );
+        return;
+    }
+
+    if (getParamById (PARAM_CONTROL_MODE) ) {
+        // Cooling mode turns relay on when the temperature is over setpoint
+        error = getSetpoint() - getTemperature();
+
+        if (mode) {
+            error = -error;
+        }
+
+        nextOnTime = dutyToOnTime (updatePID (error) );
+        return;
+    }
+
     if (state) { // Relay state is enabled
-        if (getTemperature() < (getParamById (PARAM_THRESHOLD)
+        if (getTemperature() < (getSetpoint()
                                 - (getParamById (PARAM_RELAY_HYSTERESIS) >> 3) ) ) {
             timer++;
 
@@ -145,8 +325,15 @@ void refreshRelay()
             setRelay (mode);
         }
     } else { // Relay state is disabled
-        if (getTemperature() > (getParamById (PARAM_THRESHOLD)
-                                + (getParamById (PARAM_RELAY_HYSTERESIS) >> 3) ) ) {
+        // Temperature expected after the heater is cut off
+        predicted = getTemperature();
+
+        if (!mode) {
+            predicted += getModelOvershoot();
+        }
+
+        if (predicted > (getSetpoint()
+                         + (getParamById (PARAM_RELAY_HYSTERESIS) >> 3) ) ) {
             timer++;
 
             if ( (getParamById (PARAM_RELAY_DELAY) << RELAY_TIMER_MULTIPLIER) < timer) {
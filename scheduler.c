@@ -0,0 +1,185 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Table driven scheduler of periodic tasks.
+ * Every task is being run once in a given period of timer's ticks at
+ * the given phase, so tasks with the same period could be spread over
+ * different ticks. A task is either being run directly from the timer's
+ * interrupt or it is marked as pending and being run later from the
+ * main loop.
+ * While the master clock is divided, an interrupt stands for several
+ * ticks. A task which became due within them is run once at the
+ * interrupt, its next run keeps the phase.
+ */
+
+#include "scheduler.h"
+#include "adc.h"
+#include "buttons.h"
+#include "display.h"
+#include "menu.h"
+#include "profile.h"
+#include "relay.h"
+#include "timer.h"
+#include "ui.h"
+
+#define INTERRUPT_ENABLE    __asm rim __endasm;
+#define INTERRUPT_DISABLE   __asm sim __endasm;
+
+struct schedTask {
+    unsigned int period;
+    unsigned int phase;
+    unsigned char context;
+    void (*run) ();
+};
+
+/* The order of tasks corresponds to SCHED_TASK_* identifiers. Tasks
+   being run at the same tick are called in this order. */
+static const struct schedTask tasks[] = {
+    {16, 1, SCHED_RUN_ISR, refreshMenu},
+    {256, 2, SCHED_RUN_ISR, startADC},
+    {256, 3, SCHED_RUN_MAIN, refreshTemperature},
+    {256, 4, SCHED_RUN_MAIN, refreshRelay},
+    {500, 5, SCHED_RUN_MAIN, refreshProfile},
+    {1, 0, SCHED_RUN_ISR, refreshDisplay},
+    {50, 6, SCHED_RUN_ISR, tickRelay},
+    {128, 7, SCHED_RUN_MAIN, tickUi},
+    {32, 8, SCHED_RUN_MAIN, refreshAnimation},
+    {1, 0, SCHED_RUN_ISR, tickButtons}
+};
+
+#define SCHED_TASKS_COUNT   sizeof tasks / sizeof tasks[0]
+
+/* Number of ticks remaining until the next run of each task. */
+static unsigned int countdown[SCHED_TASKS_COUNT];
+/* The tick when a deferred task became pending. */
+static unsigned int dueTick[SCHED_TASKS_COUNT];
+/* Number of times a deferred task became due while still pending. */
+static unsigned int overruns[SCHED_TASKS_COUNT];
+/* The largest delay in ticks of a deferred task from its due tick. */
+static unsigned int jitter[SCHED_TASKS_COUNT];
+/* Bit field of deferred tasks waiting to be run from the main loop. */
+static unsigned int pending;
+
+/**
+ * @brief Initialize the countdown of every task with its phase and
+ *  reset statistics.
+ */
+void initScheduler()
+{
+    unsigned char i;
+
+    for (i = 0; i < SCHED_TASKS_COUNT; i++) {
+        countdown[i] = tasks[i].phase;
+        overruns[i] = 0;
+        jitter[i] = 0;
+    }
+
+    pending = 0;
+}
+
+/**
+ * @brief This function is being called during timer's interrupt
+ *  request so keep it extremely small and fast.
+ *  Runs the tasks which are due within the passed ticks in interrupt
+ *  context and marks the deferred ones as pending.
+ * @param weight
+ *  Number of ticks being passed since the previous call.
+ */
+void tickScheduler (unsigned char weight)
+{
+    unsigned char i;
+    unsigned int mask, late;
+
+    for (i = 0, mask = 1; i < SCHED_TASKS_COUNT; i++, mask <<= 1) {
+        if (countdown[i] >= weight) {
+            countdown[i] -= weight;
+            continue;
+        }
+
+        // Ticks being passed since the task became due
+        late = weight - 1 - countdown[i];
+        countdown[i] = tasks[i].period > late ? tasks[i].period - 1 - late : 0;
+
+        if (tasks[i].context == SCHED_RUN_ISR) {
+            tasks[i].run();
+        } else {
+            if (pending & mask) {
+                overruns[i]++;
+            } else {
+                pending |= mask;
+                dueTick[i] = getTickCount();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Runs pending tasks. This function is being called from the
+ *  main loop.
+ */
+void runScheduledTasks()
+{
+    unsigned char i;
+    unsigned int mask, ready, delay;
+
+    INTERRUPT_DISABLE
+    ready = pending;
+    INTERRUPT_ENABLE
+
+    for (i = 0, mask = 1; ready != 0; i++, mask <<= 1) {
+        if ( (ready & mask) == 0) {
+            continue;
+        }
+
+        ready &= ~mask;
+        delay = getTickCount() - dueTick[i];
+
+        if (delay > jitter[i]) {
+            jitter[i] = delay;
+        }
+
+        // The task could be marked as pending again while it is running.
+        INTERRUPT_DISABLE
+        pending &= ~mask;
+        INTERRUPT_ENABLE
+        tasks[i].run();
+    }
+}
+
+/**
+ * @brief Gets number of periods when a deferred task was not run in time.
+ * @param id
+ *  Identifier of the task.
+ * @return number of overruns.
+ */
+unsigned int getTaskOverruns (unsigned char id)
+{
+    return overruns[id];
+}
+
+/**
+ * @brief Gets the largest delay of a deferred task being run from the
+ *  main loop after it became due.
+ * @param id
+ *  Identifier of the task.
+ * @return delay in ticks.
+ */
+unsigned int getTaskJitter (unsigned char id)
+{
+    return jitter[id];
+}
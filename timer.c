@@ -23,37 +23,26 @@
 #include "timer.h"
 #include "stm8s003/clock.h"
 #include "stm8s003/timer.h"
-#include "adc.h"
-#include "display.h"
-#include "params.h"
-#include "menu.h"
-#include "relay.h"
+#include "power.h"
+#include "profile.h"
+#include "scheduler.h"
 
 #define TICKS_IN_SECOND     500
-#define BITS_FOR_TICKS      9
-#define BITS_FOR_SECONDS    6
-#define BITS_FOR_MINUTES    6
-#define BITS_FOR_HOURS      5
-#define BITS_FOR_DAYS       6
-#define SECONDS_FIRST_BIT   BITS_FOR_TICKS + 1
-#define MINUTES_FIRST_BIT   BITS_FOR_TICKS + BITS_FOR_SECONDS + 1
-#define HOURS_FIRST_BIT     BITS_FOR_TICKS + BITS_FOR_SECONDS + BITS_FOR_MINUTES + 1
-#define DAYS_FIRST_BIT      BITS_FOR_TICKS + BITS_FOR_SECONDS + BITS_FOR_MINUTES + BITS_FOR_HOURS + 1
-#define BITMASK(L)          ( ~ (0xFFFFFFFF << (L) ) )
-#define NBITMASK(L)         (0xFFFFFFFF << (L) )
+#define SECONDS_IN_MINUTE   60
+#define SECONDS_IN_HOUR     3600
+#define SECONDS_IN_DAY      86400
 
 /**
- * Uptime counter
- * |--Day--|--Hour--|--Minute--|--Second--|--Ticks--|
- * 31      26       21         15         9         0
+ * Uptime counter. The number of seconds is decomposed into calendar
+ * values only when they are requested. The counter is volatile, so both
+ * readings in getUptime() are really made.
  */
-static unsigned long uptime;
-/**
- * |--Hour--|--Minute--|
- * 11       6          0
- */
-static unsigned int fTimer;
-static unsigned char fTimerSeconds;
+static volatile unsigned long uptimeSeconds;
+static unsigned int uptimeTicks;
+/* Free running counter of ticks. */
+static unsigned int tickCount;
+/* Number of ticks being passed at every interrupt. */
+static unsigned char tickWeight;
 
 /**
  * @brief Utility function. Appends characters from one string to the
@@ -83,75 +72,62 @@ static void strAppend (unsigned char * src, unsigned char * dst)
  */
 void initTimer()
 {
-    CLK_CKDIVR = 0x00;  // Set the frequency to 16 MHz
     TIM4_PSCR = 0x07;   // CLK / 128 = 125KHz
     TIM4_ARR = 0xF5;    // 125KHz /  250(0xFA) = 500Hz
     TIM4_IER = 0x01;    // Enable interrupt on update event
     TIM4_CR1 = 0x05;    // Enable timer
     resetUptime();
-    fTimer = 0;
+    tickCount = 0;
+    tickWeight = 1;
 }
 
 /**
- * @brief Starts fermentation timer.
+ * @brief Sets the number of ticks being passed at every interrupt. The
+ *  rate of interrupts follows the master clock, so it is divided along
+ *  with the master clock by the power manager.
+ * @param weight
+ *  Number of 2 ms ticks per interrupt.
  */
-void startFTimer()
+void setTickWeight (unsigned char weight)
 {
-    fTimer = ( (getParamById (PARAM_FERMENTATION_TIME) - 1) << BITS_FOR_MINUTES) + 59;
+    tickWeight = weight;
 }
 
 /**
- * @brief Stops fermentation timer.
+ * @brief Sets value of uptime counter to zero.
  */
-void stopFTimer()
+void resetUptime()
 {
-    fTimer = 0;
+    uptimeSeconds = 0;
+    uptimeTicks = 0;
 }
 
 /**
- * @brief Gets minutes part of the fermentation timer current value.
- * @return number of minutes remaining until end of that hour.
+ * @brief Gets number of seconds being passed since last reset.
+ *  The counter is being changed in timer's interrupt, so it is read
+ *  until two consecutive readings are equal.
+ * @return value of uptime counter.
  */
-unsigned char getFTimerMinutes()
+unsigned long getUptime()
 {
-    return (unsigned char) (fTimer & BITMASK (BITS_FOR_MINUTES) );
-}
+    unsigned long val;
 
-/**
- * @brief Gets hours part of the fermentation timer current value.
- * @return number of hours remaining.
- */
-unsigned char getFTimerHours()
-{
-    return (unsigned char) (fTimer >> BITS_FOR_MINUTES);
-}
+    do {
+        val = uptimeSeconds;
+    } while (val != uptimeSeconds);
 
-/**
- * @brief Checks fermentation timer to be active.
- * @return True if fermentation timer is active.
- */
-bool isFTimer()
-{
-    return fTimer != 0;
+    return val;
 }
 
 /**
- * @brief Sets value of uptime counter to zero.
+ * @brief Gets value of free running counter of ticks. This counter
+ *  wraps around every 131 seconds, so it is suitable for measurement
+ *  of short time intervals only.
+ * @return number of ticks.
  */
-void resetUptime()
+unsigned int getTickCount()
 {
-    uptime = 0;
-}
-
-/**
- * @brief Gets raw value of bit-mapped uptime counter.
- * |--Day--|--Hour--|--Minute--|--Second--|--Ticks--|
- * 31      26       21         15         9         0
- * @return value of uptime counter.
- */
-unsigned long getUptime()
-{
-    return uptime;
+    return tickCount;
 }
 
 /**
@@ -160,7 +136,7 @@ unsigned long getUptime()
  */
 unsigned int getUptimeTicks()
 {
-    return (unsigned int) (uptime & BITMASK (BITS_FOR_TICKS) );
+    return uptimeTicks;
 }
 
 /**
@@ -169,7 +145,7 @@ unsigned int getUptimeTicks()
  */
 unsigned char getUptimeSeconds()
 {
-    return (unsigned char) ( (uptime >> SECONDS_FIRST_BIT) & BITMASK (BITS_FOR_SECONDS) );
+    return (unsigned char) (getUptime() % SECONDS_IN_MINUTE);
 }
 
 /**
@@ -178,7 +154,7 @@ unsigned char getUptimeSeconds()
  */
 unsigned char getUptimeMinutes()
 {
-    return (unsigned char) ( (uptime >> MINUTES_FIRST_BIT) & BITMASK (BITS_FOR_MINUTES) );
+    return (unsigned char) ( (getUptime() / SECONDS_IN_MINUTE) % 60);
 }
 
 /**
@@ -187,16 +163,16 @@ unsigned char getUptimeMinutes()
  */
 unsigned char getUptimeHours()
 {
-    return (unsigned char) ( (uptime >> HOURS_FIRST_BIT) & BITMASK (BITS_FOR_HOURS) );
+    return (unsigned char) ( (getUptime() / SECONDS_IN_HOUR) % 24);
 }
 
 /**
  * @brief Gets amount of days being passed since last reset.
  * @return amount of days.
  */
-unsigned char getUptimeDays()
+unsigned int getUptimeDays()
 {
-    return (unsigned char) ( (uptime >> DAYS_FIRST_BIT) & BITMASK (BITS_FOR_DAYS) );
+    return (unsigned int) (getUptime() / SECONDS_IN_DAY);
 }
 
 /**
@@ -215,7 +191,8 @@ unsigned char getUptimeDays()
  */
 void uptimeToString (unsigned char* strBuff, const unsigned char* format)
 {
-    unsigned char i, j, f[3], v;
+    unsigned char i, j, f[3];
+    unsigned int v;
 
     for (i = 0; format[i] != 0; i++) {
         switch (format[i]) {
@@ -313,60 +290,24 @@ void uptimeToString (unsigned char* strBuff, const unsigned char* format)
 /**
  * @brief This function is timer's interrupt request handler
  * so keep it small and fast as much as possible.
+ * Tasks of the tick are run with the CPU divider cleared, the divider
+ * being set by the power manager is restored on exit. The master clock
+ * divider is kept, so does the rate of interrupts.
  */
 void TIM4_UPD_handler() __interrupt (23)
 {
-    TIM4_SR &= ~TIM_SR1_UIF; // Reset flag
-
-    if ( ( (unsigned int) (uptime & BITMASK (BITS_FOR_TICKS) ) ) >= TICKS_IN_SECOND) {
-        uptime &= NBITMASK (SECONDS_FIRST_BIT);
-        uptime += (unsigned long) 1 << SECONDS_FIRST_BIT;
-
-        // Increment minutes count when 60 seconds have passed.
-        if ( ( (unsigned char) (uptime >> SECONDS_FIRST_BIT) & BITMASK (BITS_FOR_SECONDS) ) == 60) {
-            uptime &= NBITMASK (MINUTES_FIRST_BIT);
-            uptime += (unsigned long) 1 << MINUTES_FIRST_BIT;
-        }
-
-        // Increment hours count when 60 minutes have passed.
-        if ( ( (unsigned char) (uptime >> MINUTES_FIRST_BIT) & BITMASK (BITS_FOR_MINUTES) ) == 60) {
-            uptime &= NBITMASK (HOURS_FIRST_BIT);
-            uptime += (unsigned long) 1 << HOURS_FIRST_BIT;
-        }
-
-        // Increment days count when 24 hours have passed.
-        if ( ( (unsigned char) (uptime >> HOURS_FIRST_BIT) & BITMASK (BITS_FOR_HOURS) ) == 24) {
-            uptime &= NBITMASK (DAYS_FIRST_BIT);
-            uptime += (unsigned long) 1 << DAYS_FIRST_BIT;
-        }
+    unsigned char clk = CLK_CKDIVR;
 
-        // Decrement fermentation timer value.
-        if (isFTimer() && fTimerSeconds == getUptimeSeconds() ) {
-            if (getFTimerMinutes() > 0) {
-                fTimer--;
-
-                // Disable the relay functionality when the fermentation timer is exhausted.
-                if (fTimer == 0) {
-                    enableRelay (false);
-                }
-            } else {
-                fTimer = ( (getFTimerHours() - 1) << BITS_FOR_MINUTES) + 59;
-            }
-        }
-    }
-
-    uptime++;
-
-    // Try not to call all refresh functions at once.
-    buzzRelay ();
+    CLK_CKDIVR = clk & ~POWER_CLK_CPUDIV;
+    TIM4_SR &= ~TIM_SR1_UIF; // Reset flag
+    uptimeTicks += tickWeight;
+    tickCount += tickWeight;
 
-    if ( ( (unsigned char) getUptimeTicks() & 0x0F) == 1) {
-        refreshMenu();
-    } else if ( ( (unsigned char) getUptimeTicks() & 0xFF) == 2) {
-        startADC();
-    } else if ( ( (unsigned char) getUptimeTicks() & 0xFF) == 3) {
-        refreshRelay();
+    if (uptimeTicks >= TICKS_IN_SECOND) {
+        uptimeTicks -= TICKS_IN_SECOND;
+        uptimeSeconds++;
     }
 
-    refreshDisplay();
+    tickScheduler (tickWeight);
+    CLK_CKDIVR = clk;
 }
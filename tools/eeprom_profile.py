@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+#
+# This file is part of the firmware for yogurt maker project
+# (https://github.com/mister-grumbler/yogurt-maker).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Generator of the EEPROM image with stages of the fermentation profile.
+
+Every stage is given as "target:rate:hold" where:
+  target - temperature in degrees of Celsius (e.g. 43.5);
+  rate - ramp rate in tenth of degrees of Celsius per hour, 0 means an
+         immediate change of setpoint;
+  hold - hold time in hours.
+Stages are stored at the beginning of EEPROM (see profile.c), 4 bytes
+per stage, the unused stages are left empty. The image covers the
+stages only, so parameters stored after them are kept when the image
+is written, e.g.:
+  stm8flash -c stlinkv2 -p stm8s003f3 -s eeprom -w Build/eeprom.ihx
+An image without stages clears the profile, so the fermentation timer
+holds the threshold parameter.
+
+Usage:
+  eeprom_profile.py [--out file] [stage ...]
+"""
+
+import argparse
+import sys
+
+EEPROM_ADDR = 0x4000
+STAGES_MAX = 4
+STAGE_SIZE = 4
+TARGET_MIN = -450
+TARGET_MAX = 1050
+
+
+def parse_stage(text):
+    """Converts "target:rate:hold" into the tuple of stored values."""
+    try:
+        target, rate, hold = text.split(":")
+        stage = (int(round(float(target) * 10)), int(rate), int(hold))
+    except ValueError:
+        raise argparse.ArgumentTypeError("stage should be target:rate:hold, got '%s'" % text)
+
+    if not TARGET_MIN <= stage[0] <= TARGET_MAX:
+        raise argparse.ArgumentTypeError("target of '%s' is out of range" % text)
+
+    if not (0 <= stage[1] <= 255 and 0 <= stage[2] <= 255):
+        raise argparse.ArgumentTypeError("rate and hold of '%s' should be 0 ... 255" % text)
+
+    if stage[1] == 0 and stage[2] == 0:
+        raise argparse.ArgumentTypeError("stage '%s' with zero rate and hold ends the profile" % text)
+
+    return stage
+
+
+def make_image(stages):
+    """Packs stages the way sdcc lays out the structure (big-endian int)."""
+    data = bytearray(STAGES_MAX * STAGE_SIZE)
+
+    for i, (target, rate, hold) in enumerate(stages):
+        data[i * STAGE_SIZE:(i + 1) * STAGE_SIZE] = bytes([
+            (target >> 8) & 0xFF, target & 0xFF, rate, hold])
+
+    return data
+
+
+def to_ihx(data, addr):
+    """Formats data as Intel HEX records."""
+    lines = []
+
+    for i in range(0, len(data), 16):
+        chunk = data[i:i + 16]
+        a = addr + i
+        record = bytes([len(chunk), (a >> 8) & 0xFF, a & 0xFF, 0]) + chunk
+        lines.append(":%s%02X" % (record.hex().upper(), -sum(record) & 0xFF))
+
+    lines.append(":00000001FF")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--out", help="output file, stdout by default")
+    parser.add_argument("stages", nargs="*", type=parse_stage, metavar="stage",
+                        help="target:rate:hold")
+    args = parser.parse_args()
+
+    if len(args.stages) > STAGES_MAX:
+        parser.error("at most %d stages are supported" % STAGES_MAX)
+
+    text = to_ihx(make_image(args.stages), EEPROM_ADDR)
+
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+#
+# This file is part of the firmware for yogurt maker project
+# (https://github.com/mister-grumbler/yogurt-maker).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Cycle profiling of interrupt handlers using the STM8 simulator (sstm8)
+shipped with sdcc.
+
+The firmware image is loaded into the simulator, a breakpoint is placed
+on the entry and on the "iret" instruction of every profiled handler and
+the simulation is run for a given amount of simulated time. The number
+of cycles between entry and exit of each invocation is collected and
+min/avg/max values are written into a JSON report along with the share
+of simulated time being spent in the handlers, which is used to compare
+power saving modes.
+
+The simulator is driven by a command script fed through stdin, so no
+interaction with the simulator's console is required. Optional stimulus
+can be given as a file with lines "<seconds> <simulator command>", each
+command is sent to the simulator when the given simulated time is
+reached (e.g. to change the state of button inputs).
+
+Usage:
+  isr_profile.py [--sim sstm8] [--seconds N] [--map file.map]
+                 [--out report.json] [--stimulus file] image.ihx
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+HANDLERS = ["TIM4_UPD_handler", "ADC1_EOC_handler", "EXTI2_handler"]
+# Interrupts per simulated second which are expected in the worst case:
+# 500 timer ticks plus a reserve for ADC and button interrupts.
+STOPS_PER_SECOND = 2 * (500 + 20)
+CLOCK_HZ = 16000000
+TICK_BUDGET = CLOCK_HZ // 500
+
+RE_SYMBOL = re.compile(r"^\s*(?:0x)?([0-9A-Fa-f]{4,8})\s+(_\w+)\b")
+RE_IRET = re.compile(r"^[\s>]*(?:0x)?([0-9A-Fa-f]{4,8})\b.*\biret\b", re.I)
+RE_STOP = re.compile(r"Stop at (?:0x)?([0-9A-Fa-f]+)")
+RE_CLKS = re.compile(r"\((\d+)\s+clks?\)")
+
+
+def read_symbols(map_file):
+    """Reads addresses of global symbols from the linker's map file."""
+    symbols = {}
+
+    with open(map_file) as f:
+        for line in f:
+            m = RE_SYMBOL.match(line)
+
+            if m:
+                symbols[m.group(2)] = int(m.group(1), 16)
+
+    return symbols
+
+
+def simulate(args, commands):
+    """Runs simulator with given list of commands, returns its output."""
+    cmd = [args.sim, "-t", args.type, "-X", str(CLOCK_HZ), args.image]
+    proc = subprocess.run(cmd, input="\n".join(commands + ["quit", ""]),
+                          stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+    return proc.stdout
+
+
+def find_exits(args, entries, symbols):
+    """Disassembles every handler and returns addresses of its "iret"."""
+    addresses = sorted(set(symbols.values()))
+    bounds = {}
+    commands = []
+
+    for name, start in entries.items():
+        stop = next((a for a in addresses if a > start), start + 0x400)
+        bounds[name] = (start, stop)
+        commands.append("dc 0x%x 0x%x" % (start, stop - 1))
+
+    exits = {}
+
+    for line in simulate(args, commands).splitlines():
+        m = RE_IRET.match(line)
+
+        if not m:
+            continue
+
+        addr = int(m.group(1), 16)
+
+        for name, (start, stop) in bounds.items():
+            if start <= addr < stop:
+                exits.setdefault(name, []).append(addr)
+
+    return exits
+
+
+def read_stimulus(file_name):
+    stimulus = []
+
+    if file_name:
+        with open(file_name) as f:
+            for line in f:
+                line = line.strip()
+
+                if line and not line.startswith("#"):
+                    at, command = line.split(None, 1)
+                    stimulus.append((float(at), command))
+
+    return sorted(stimulus)
+
+
+def profile(args, entries, exits):
+    stimulus = read_stimulus(args.stimulus)
+    commands = ["break 0x%x" % a for a in entries.values()]
+
+    for addrs in exits.values():
+        commands += ["break 0x%x" % a for a in addrs]
+
+    stops = int(args.seconds * STOPS_PER_SECOND)
+
+    for i in range(stops):
+        while stimulus and stimulus[0][0] * STOPS_PER_SECOND <= i:
+            commands.append(stimulus.pop(0)[1])
+
+        commands += ["run", "state"]
+
+    owner = {}
+
+    for name, addr in entries.items():
+        owner[addr] = (name, True)
+
+    for name, addrs in exits.items():
+        for addr in addrs:
+            owner[addr] = (name, False)
+
+    samples = dict((name, []) for name in HANDLERS)
+    started = {}
+    stop_at = None
+    total = 0
+    limit = int(args.seconds * CLOCK_HZ)
+
+    for line in simulate(args, commands).splitlines():
+        m = RE_STOP.search(line)
+
+        if m:
+            stop_at = int(m.group(1), 16)
+            continue
+
+        m = RE_CLKS.search(line)
+
+        if not m or stop_at is None:
+            continue
+
+        clks = int(m.group(1))
+        name, entry = owner.get(stop_at, (None, False))
+        stop_at = None
+
+        if clks > limit:
+            break
+
+        total = clks
+
+        if name is None:
+            continue
+
+        if entry:
+            started[name] = clks
+        elif name in started:
+            samples[name].append(clks - started.pop(name))
+
+    return samples, total
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image")
+    parser.add_argument("--sim", default="sstm8")
+    parser.add_argument("--type", default="STM8S003")
+    parser.add_argument("--map")
+    parser.add_argument("--seconds", type=float, default=10)
+    parser.add_argument("--stimulus")
+    parser.add_argument("--out")
+    args = parser.parse_args()
+
+    map_file = args.map or os.path.splitext(args.image)[0] + ".map"
+    symbols = read_symbols(map_file)
+    entries = {}
+
+    for name in HANDLERS:
+        if "_" + name not in symbols:
+            sys.exit("symbol _%s is not found in %s" % (name, map_file))
+
+        entries[name] = symbols["_" + name]
+
+    exits = find_exits(args, entries, symbols)
+
+    for name in HANDLERS:
+        if name not in exits:
+            sys.exit("unable to find iret of %s" % name)
+
+    samples, total = profile(args, entries, exits)
+    report = {
+        "image": args.image,
+        "clock_hz": CLOCK_HZ,
+        "tick_budget_cycles": TICK_BUDGET,
+        "simulated_cycles": total,
+        "handlers": {},
+    }
+    print("%-20s %8s %8s %8s %8s" % ("handler", "count", "min", "avg", "max"))
+
+    for name in HANDLERS:
+        s = samples[name]
+        stat = {
+            "count": len(s),
+            "min": min(s) if s else 0,
+            "avg": sum(s) // len(s) if s else 0,
+            "max": max(s) if s else 0,
+        }
+        report["handlers"][name] = stat
+        print("%-20s %8d %8d %8d %8d" % (name, stat["count"], stat["min"],
+                                          stat["avg"], stat["max"]))
+
+    busy = sum(sum(s) for s in samples.values())
+    report["busy_percent"] = round(busy * 100.0 / total, 2) if total else 0
+    worst = report["handlers"]["TIM4_UPD_handler"]["max"]
+    print("worst tick: %d of %d cycles (%d%%)" % (worst, TICK_BUDGET,
+                                                 worst * 100 // TICK_BUDGET))
+    print("time in handlers: %.2f%%" % report["busy_percent"])
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+            f.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+#
+# This file is part of the firmware for yogurt maker project
+# (https://github.com/mister-grumbler/yogurt-maker).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Generator of the lookup tables for conversion of ADC results into
+temperature for the NTC thermistor connected to the ground with a
+divider resistor connected to the reference voltage.
+
+The range of ADC results is split into segments of equal length. For
+every segment the temperature at its first code and the slope are
+stored, so the conversion is:
+  T = base[code >> SEGMENT_BITS]
+      - ((code & SEGMENT_MASK) * slope[code >> SEGMENT_BITS]) >> SLOPE_SHIFT
+Temperature is in tenth of degrees of Celsius.
+
+Usage:
+  thermistor.py [--probe name] [--divider ohms] [--adc-bits N]
+                [--segment-bits N] [--out file] [--list]
+"""
+
+import argparse
+import math
+import sys
+
+KELVIN = 273.15
+
+# The resistance is calculated either using Beta coefficient and the
+# nominal resistance at 25C or using Steinhart-Hart coefficients.
+PROBES = {
+    # The probe which is supplied with W1209 board, fitted to the
+    # lookup table of original firmware.
+    "w1209": {"sh": (3.830062e-4, 3.240286e-4, -1.655488e-8)},
+    "ntc10k_b3435": {"r25": 10000, "beta": 3435},
+    "ntc10k_b3950": {"r25": 10000, "beta": 3950},
+    "ntc50k_b3950": {"r25": 50000, "beta": 3950},
+    "ntc100k_b3950": {"r25": 100000, "beta": 3950},
+}
+
+
+def temperature(probe, r):
+    """Temperature in degrees of Celsius for given resistance of probe."""
+    if "sh" in probe:
+        a, b, c = probe["sh"]
+        ln = math.log(r)
+        return 1.0 / (a + b * ln + c * ln ** 3) - KELVIN
+
+    return 1.0 / (1.0 / (25 + KELVIN) + math.log(r / probe["r25"]) / probe["beta"]) - KELVIN
+
+
+def code_to_temp(probe, args, code):
+    """Temperature in tenth of degrees for given result of conversion."""
+    full = 1 << args.adc_bits
+
+    if code <= 0:
+        t = args.max_temp
+    elif code >= full:
+        t = args.min_temp
+    else:
+        t = temperature(probe, args.divider * code / (full - code))
+
+    return max(args.min_temp, min(args.max_temp, t)) * 10
+
+
+def generate(args):
+    probe = PROBES[args.probe]
+    seg = 1 << args.segment_bits
+    count = 1 << (args.adc_bits - args.segment_bits)
+    base = []
+    slope = []
+
+    for i in range(count):
+        t0 = code_to_temp(probe, args, i * seg)
+        t1 = code_to_temp(probe, args, (i + 1) * seg)
+        base.append(int(round(t0)))
+        slope.append((t0 - t1) / seg)
+
+    # The largest shift which keeps the product within 16 bits.
+    shift = 0
+
+    while shift < 15 and max(slope) * (1 << (shift + 1)) * (seg - 1) < 65536:
+        shift += 1
+
+    slope = [int(round(s * (1 << shift))) for s in slope]
+    lines = [
+        "/*",
+        " * Generated by tools/thermistor.py, do not edit.",
+        " * Probe: %s, divider: %d Ohm, ADC: %d bits." % (args.probe, args.divider,
+                                                          args.adc_bits),
+        " */",
+        "",
+        "#ifndef THERMISTOR_H",
+        "#define THERMISTOR_H",
+        "",
+        "#define NTC_ADC_BITS        %d" % args.adc_bits,
+        "#define NTC_SEGMENT_BITS    %d" % args.segment_bits,
+        "#define NTC_SLOPE_SHIFT     %d" % shift,
+        "",
+        "/* Temperature at the first code of every segment. */",
+        "static const int ntcBase[] = {",
+    ]
+    lines += table(base)
+    lines += [
+        "};",
+        "",
+        "/* Decrease of temperature per code within every segment. */",
+        "static const unsigned int ntcSlope[] = {",
+    ]
+    lines += table(slope)
+    lines += ["};", "", "#endif", ""]
+    return "\n".join(lines)
+
+
+def table(values):
+    rows = []
+
+    for i in range(0, len(values), 10):
+        rows.append("    " + ", ".join(str(v) for v in values[i:i + 10]) + ",")
+
+    rows[-1] = rows[-1][:-1]
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--probe", default="w1209")
+    parser.add_argument("--divider", type=int, default=20000)
+    parser.add_argument("--adc-bits", type=int, default=10)
+    parser.add_argument("--segment-bits", type=int, default=4)
+    parser.add_argument("--min-temp", type=float, default=-52)
+    parser.add_argument("--max-temp", type=float, default=112)
+    parser.add_argument("--out")
+    parser.add_argument("--list", action="store_true")
+    args = parser.parse_args()
+
+    if args.list:
+        print("\n".join(sorted(PROBES)))
+        return
+
+    if args.probe not in PROBES:
+        sys.exit("unknown probe %s, use one of: %s" % (args.probe, ", ".join(sorted(PROBES))))
+
+    text = generate(args)
+
+    if not args.out:
+        sys.stdout.write(text)
+        return
+
+    # Keep the file untouched when nothing is changed to avoid rebuilding.
+    try:
+        with open(args.out) as f:
+            if f.read() == text:
+                return
+    except IOError:
+        pass
+
+    with open(args.out, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * User interface rendered on change.
+ * Producers of shown values mark their source as dirty. The main loop
+ * selects the view to be shown and renders it only when the view itself
+ * or one of the sources it depends on is changed.
+ */
+
+#include "ui.h"
+#include "adc.h"
+#include "autotune.h"
+#include "buttons.h"
+#include "display.h"
+#include "menu.h"
+#include "params.h"
+#include "profile.h"
+#include "relay.h"
+#include "timer.h"
+
+#define UI_MASK(S)              (1 << (S))
+
+/* Views */
+#define UI_VIEW_NONE            0
+#define UI_VIEW_FAULT           1
+#define UI_VIEW_ROOT            2
+#define UI_VIEW_ROOT_FTIMER     3
+#define UI_VIEW_SET_TIMER       4
+#define UI_VIEW_SELECT_PARAM    5
+#define UI_VIEW_CHANGE_PARAM    6
+#define UI_VIEW_ERROR           7
+
+/* Sources every view depends on, the order corresponds to UI_VIEW_* */
+static const unsigned char viewInputs[] = {
+    0,
+    UI_MASK (UI_SOURCE_CONTROL),
+    UI_MASK (UI_SOURCE_TEMPERATURE) | UI_MASK (UI_SOURCE_MENU) | UI_MASK (UI_SOURCE_CONTROL),
+    UI_MASK (UI_SOURCE_TEMPERATURE) | UI_MASK (UI_SOURCE_MENU) | UI_MASK (UI_SOURCE_CONTROL) |
+    UI_MASK (UI_SOURCE_CLOCK),
+    UI_MASK (UI_SOURCE_MENU),
+    UI_MASK (UI_SOURCE_MENU),
+    UI_MASK (UI_SOURCE_MENU),
+    0
+};
+
+/* One byte per source, so it could be marked from interrupts without
+   read-modify-write. */
+static volatile unsigned char dirty[UI_SOURCE_COUNT];
+static unsigned char view;
+static bool testMode;
+static unsigned char stringBuffer[7];
+/* Pages of the root view being shown one after another */
+static unsigned char timerBuffer[7];
+static unsigned char autotuneBuffer[6];
+static const unsigned char* pages[3];
+/* Scrolling texts of faults, the order corresponds to RELAY_FAULT_* */
+static const unsigned char* const faultText[] = {
+    "E01 HEAT", "E02 PROBE"
+};
+
+/**
+ * @brief Initialize the user interface, so the first view is rendered.
+ */
+void initUi()
+{
+    unsigned char i;
+
+    for (i = 0; i < UI_SOURCE_COUNT; i++) {
+        dirty[i] = true;
+    }
+
+    view = UI_VIEW_NONE;
+    testMode = true;
+}
+
+/**
+ * @brief Marks the source of shown values as changed.
+ * @param source - one of UI_SOURCE_* identifiers.
+ */
+void markUiDirty (unsigned char source)
+{
+    dirty[source] = true;
+}
+
+/**
+ * @brief Marks the clock as changed, so blinking and alternating values
+ *  are updated. This function is being called from the main loop every
+ *  128 ticks, the view is rendered right after it.
+ */
+void tickUi()
+{
+    dirty[UI_SOURCE_CLOCK] = true;
+}
+
+/**
+ * @brief Selects the view appropriate to the state of application.
+ * @return one of UI_VIEW_* identifiers.
+ */
+static unsigned char selectView()
+{
+    switch (getMenuDisplay() ) {
+    case MENU_ROOT:
+        if (getRelayFault() ) {
+            return UI_VIEW_FAULT;
+        }
+
+        // Minutes of the fermentation timer are changed by the clock.
+        if (isRelayEnabled() && isFTimer() ) {
+            return UI_VIEW_ROOT_FTIMER;
+        }
+
+        return UI_VIEW_ROOT;
+
+    case MENU_SET_TIMER:
+        return UI_VIEW_SET_TIMER;
+
+    case MENU_SELECT_PARAM:
+        return UI_VIEW_SELECT_PARAM;
+
+    case MENU_CHANGE_PARAM:
+        return UI_VIEW_CHANGE_PARAM;
+
+    default:
+        return UI_VIEW_ERROR;
+    }
+}
+
+/**
+ * @brief Renders pages of the root view: the temperature, the state of
+ *  fermentation timer if the relay is enabled and the progress of
+ *  auto-tuning if it is running.
+ */
+static void renderRoot()
+{
+    unsigned char count = 1;
+    int temp = getTemperature();
+
+    itofpa (temp, stringBuffer, 0);
+    pages[0] = stringBuffer;
+
+    // Limits are in whole degrees of Celsius
+    if (getParamById (PARAM_OVERHEAT_INDICATION) ) {
+        if (temp < getParamById (PARAM_MIN_TEMPERATURE) * 10) {
+            pages[0] = "LLL";
+        } else if (temp > getParamById (PARAM_MAX_TEMPERATURE) * 10) {
+            pages[0] = "HHH";
+        }
+    }
+
+    if (isRelayEnabled() ) {
+        if (isFTimer() ) {
+            timerBuffer[0] = 0;
+
+            // Making blink the dot in between the hours and minutes.
+            if ( (getUptimeTicks() & 0x100) ) {
+                uptimeToString (timerBuffer, "Ttt");
+            } else {
+                uptimeToString (timerBuffer, "T.tt");
+            }
+
+            pages[count++] = timerBuffer;
+        } else {
+            // Show "n.t.r." -> no timer is running
+            pages[count++] = "N.T.R.";
+        }
+    }
+
+    if (isAutotune() ) {
+        autotuneBuffer[0] = 'A';
+        autotuneBuffer[1] = '.';
+        autotuneBuffer[2] = 'T';
+        autotuneBuffer[3] = '.';
+        autotuneBuffer[4] = '0' + getAutotuneStage() - 1;
+        autotuneBuffer[5] = 0;
+        pages[count++] = autotuneBuffer;
+    }
+
+    setDisplayPages (pages, count);
+}
+
+/**
+ * @brief Renders the given view on the display.
+ * @param id - one of UI_VIEW_* identifiers.
+ */
+static void renderView (unsigned char id)
+{
+    switch (id) {
+    case UI_VIEW_FAULT:
+        // Keep showing the latched fault until a button is pushed
+        setDisplayScroll (faultText[getRelayFault() - 1]);
+        setDisplayBlink (false);
+        return;
+
+    case UI_VIEW_ROOT:
+    case UI_VIEW_ROOT_FTIMER:
+        renderRoot();
+        setDisplayBlink (false);
+        return;
+
+    case UI_VIEW_SET_TIMER:
+        paramToString (PARAM_FERMENTATION_TIME, stringBuffer);
+        setDisplayStr (stringBuffer);
+        // The value is steady while it is being changed
+        setDisplayBlink (!getButton2() && !getButton3() );
+        return;
+
+    case UI_VIEW_SELECT_PARAM:
+        stringBuffer[0] = 'P';
+        itofpa (getParamId(), stringBuffer + 1, 6);
+        break;
+
+    case UI_VIEW_CHANGE_PARAM:
+        paramToString (getParamId(), stringBuffer);
+        break;
+
+    default:
+        setDisplayStr ("ERR");
+        setDisplayBlink (true);
+        return;
+    }
+
+    setDisplayStr (stringBuffer);
+    setDisplayBlink (false);
+}
+
+/**
+ * @brief Renders the current view when it is changed. This function is
+ *  being called from the main loop.
+ */
+void refreshUi()
+{
+    unsigned char i, changed = 0, next;
+
+    for (i = 0; i < UI_SOURCE_COUNT; i++) {
+        if (dirty[i]) {
+            dirty[i] = false;
+            changed |= UI_MASK (i);
+        }
+    }
+
+    if (changed == 0) {
+        return;
+    }
+
+    // Leave the test mode of display after the first second
+    if (testMode && getUptime() > 0) {
+        setDisplayTestMode (false, "");
+        testMode = false;
+        view = UI_VIEW_NONE;
+    }
+
+    if (changed & UI_MASK (UI_SOURCE_MENU) ) {
+        setDisplayBrightness (getParamById (PARAM_BRIGHTNESS) );
+    }
+
+    next = selectView();
+
+    // The latched fault is never hidden by the sleeping display
+    if (next == UI_VIEW_FAULT) {
+        wakeDisplay();
+    }
+
+    if (next != view || changed & viewInputs[next]) {
+        view = next;
+        renderView (view);
+    }
+}
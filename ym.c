@@ -16,16 +16,23 @@
  */
 
 #include "adc.h"
+#include "alarm.h"
+#include "autotune.h"
 #include "buttons.h"
 #include "display.h"
+#include "events.h"
 #include "menu.h"
+#include "model.h"
 #include "params.h"
+#include "power.h"
+#include "profile.h"
 #include "relay.h"
+#include "scheduler.h"
 #include "timer.h"
+#include "ui.h"
 
 #define INTERRUPT_ENABLE    __asm rim __endasm;
 #define INTERRUPT_DISABLE   __asm sim __endasm;
-#define WAIT_FOR_INTERRUPT  __asm wfi __endasm;
 
 void strConcat (unsigned char * from, unsigned char * to)
 {
@@ -47,73 +54,30 @@ void strConcat (unsigned char * from, unsigned char * to)
  */
 int main()
 {
-    static unsigned char* stringBuffer[7];
-    static unsigned char* timerBuffer[5];
-    unsigned char paramMsg[] = {'P', '0', 0};
-
+    initEvents();
     initMenu();
     initButtons();
     initParamsEEPROM();
     initDisplay();
     initADC();
+    initAlarm();
     initRelay();
+    initProfile();
+    initAutotune();
+    initModel();
+    initUi();
+    initScheduler();
+    initPower();
     initTimer();
 
     INTERRUPT_ENABLE
 
     // Loop
     while (true) {
-        if (getUptimeSeconds() > 0) {
-            setDisplayTestMode (false, "");
-        }
-
-        if (getMenuDisplay() == MENU_ROOT) {
-            // Alternately show values for temperature and fermentation timer
-            // if it is running.
-            if (isRelayEnabled() && getUptimeSeconds() & 0x08) {
-                stringBuffer[0] = 0;
-
-                if (isFTimer() ) {
-                    // Making blink the dot in between the hours and minutes.
-                    if ( (getUptimeTicks() & 0x100) ) {
-                        uptimeToString ( (unsigned char*) stringBuffer, "Ttt");
-                    } else {
-                        uptimeToString ( (unsigned char*) stringBuffer, "T.tt");
-                    }
-                } else {
-                    // Show "n.t.r." -> no timer is running
-                    setDisplayStr ("N.T.R.");
-                    continue;
-                }
-
-                setDisplayStr ( (char*) stringBuffer);
-            } else {
-                int temp = getTemperature();
-                itofpa (temp, (char*) stringBuffer, 0);
-                setDisplayStr ( (char*) stringBuffer);
-
-                if (getParamById (PARAM_OVERHEAT_INDICATION) ) {
-                    if (temp < getParamById (PARAM_MIN_TEMPERATURE) ) {
-                        setDisplayStr ("LLL");
-                    } else if (temp > getParamById (PARAM_MAX_TEMPERATURE) ) {
-                        setDisplayStr ("HHH");
-                    }
-                }
-            }
-        } else if (getMenuDisplay() == MENU_SET_TIMER) {
-            paramToString (PARAM_FERMENTATION_TIME, (char*) stringBuffer);
-            setDisplayStr ( (char*) stringBuffer);
-        } else if (getMenuDisplay() == MENU_SELECT_PARAM) {
-            paramMsg[1] = '0' + getParamId();
-            setDisplayStr ( (unsigned char*) &paramMsg);
-        } else if (getMenuDisplay() == MENU_CHANGE_PARAM) {
-            paramToString (getParamId(), (char*) stringBuffer);
-            setDisplayStr ( (char *) stringBuffer);
-        } else {
-            setDisplayStr ("ERR");
-            setDisplayOff ( (bool) ( (unsigned char) getUptimeTicks() & 0x80) );
-        }
-
-        WAIT_FOR_INTERRUPT
+        runScheduledTasks();
+        processMenuEvents();
+        refreshUi();
+        refreshParams();
+        enterIdle();
     };
 }